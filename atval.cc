@@ -29,6 +29,7 @@
 #include <iostream>
 #include <dwarf.h>
 #include <memory>
+#include <vector>
 
 #include "atval.hh"
 #include "dwcst.hh"
@@ -130,13 +131,13 @@ namespace
   struct locexpr_producer
     : public value_producer
   {
-    std::shared_ptr <dwfl_context> m_dwctx;
+    dwctx_ptr m_dwctx;
     Dwarf_Attribute m_attr;
     Dwarf_Addr m_base;
     ptrdiff_t m_offset;
     size_t m_i;
 
-    locexpr_producer (std::shared_ptr <dwfl_context> dwctx,
+    locexpr_producer (dwctx_ptr dwctx,
 		      Dwarf_Attribute attr)
       : m_dwctx {dwctx}
       , m_attr (attr)
@@ -171,13 +172,13 @@ namespace
   struct macinfo_producer
     : public value_producer
   {
-    std::shared_ptr <dwfl_context> m_dwctx;
+    dwctx_ptr m_dwctx;
     Dwarf_Die m_cudie;
     Dwarf_Addr m_base;
     ptrdiff_t m_offset;
     size_t m_i;
 
-    macinfo_producer (std::shared_ptr <dwfl_context> dwctx,
+    macinfo_producer (dwctx_ptr dwctx,
 		      Dwarf_Die cudie)
       : m_dwctx {dwctx}
       , m_cudie (cudie)
@@ -282,7 +283,9 @@ namespace
 std::unique_ptr <value>
 die_ranges (Dwarf_Die die)
 {
-  coverage cov;
+  // Ranges are collected first and added in bulk, which sorts and
+  // coalesces them in one go.
+  std::vector <cov_range> ranges;
   Dwarf_Addr base; // Cache for dwarf_ranges.
   for (ptrdiff_t off = 0;;)
     {
@@ -293,9 +296,11 @@ die_ranges (Dwarf_Die die)
       if (off == 0)
 	break;
 
-      cov.add (start, end - start);
+      ranges.push_back (cov_range {start, end - start});
     }
 
+  coverage cov;
+  cov.add_all (std::move (ranges));
   return std::make_unique <value_aset> (cov, 0);
 }
 
@@ -303,7 +308,7 @@ namespace
 {
   std::unique_ptr <value_producer>
   handle_at_dependent_value (Dwarf_Attribute attr, Dwarf_Die die,
-			     std::shared_ptr <dwfl_context> dwctx)
+			     dwctx_ptr dwctx)
   {
     switch (dwarf_whatattr (&attr))
       {
@@ -598,7 +603,7 @@ namespace
 }
 
 std::unique_ptr <value_producer>
-at_value (std::shared_ptr <dwfl_context> dwctx,
+at_value (dwctx_ptr dwctx,
 	  Dwarf_Die die, Dwarf_Attribute attr)
 {
   switch (dwarf_whatform (&attr))
@@ -706,7 +711,7 @@ namespace
   // represents unary, both non-default represent binary op.
   template <unsigned N>
   std::unique_ptr <value_producer>
-  locexpr_op_values (std::shared_ptr <dwfl_context> dwctx,
+  locexpr_op_values (dwctx_ptr dwctx,
 		     Dwarf_Attribute const &at, Dwarf_Op const *op)
   {
     auto signed_cst = [] (Dwarf_Word w, constant_dom const *dom)
@@ -837,14 +842,14 @@ namespace
 }
 
 std::unique_ptr <value_producer>
-dwop_number (std::shared_ptr <dwfl_context> dwctx,
+dwop_number (dwctx_ptr dwctx,
 	     Dwarf_Attribute const &attr, Dwarf_Op const *op)
 {
   return locexpr_op_values <0> (dwctx, attr, op);
 }
 
 std::unique_ptr <value_producer>
-dwop_number2 (std::shared_ptr <dwfl_context> dwctx,
+dwop_number2 (dwctx_ptr dwctx,
 	     Dwarf_Attribute const &attr, Dwarf_Op const *op)
 {
   return locexpr_op_values <1> (dwctx, attr, op);
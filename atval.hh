@@ -35,18 +35,18 @@ class value_producer;
 class value;
 
 // Obtain a value of ATTR at DIE.
-std::unique_ptr <value_producer> at_value (std::shared_ptr <dwfl_context> dwctx,
+std::unique_ptr <value_producer> at_value (dwctx_ptr dwctx,
 					   Dwarf_Die die, Dwarf_Attribute attr);
 
 // Obtain DIE's ranges.
 std::unique_ptr <value> die_ranges (Dwarf_Die die);
 
 std::unique_ptr <value_producer>
-dwop_number (std::shared_ptr <dwfl_context> dwctx,
+dwop_number (dwctx_ptr dwctx,
 	     Dwarf_Attribute const &attr, Dwarf_Op const *op);
 
 std::unique_ptr <value_producer>
-dwop_number2 (std::shared_ptr <dwfl_context> dwctx,
+dwop_number2 (dwctx_ptr dwctx,
 	      Dwarf_Attribute const &attr, Dwarf_Op const *op);
 
 #endif /* _ATVAL_H_ */
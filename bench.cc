@@ -0,0 +1,311 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+// Throughput benchmark.  Runs each query of a catalog over each input
+// file, and reports DIEs of the input per second, results per second,
+// peak resident set size and allocations per result.  Each query is
+// run in a forked process of its own, so that it starts with cold
+// caches and its peak RSS can be told apart from that of the others.
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include "builtin-dw.hh"
+#include "dwgrep.hh"
+#include "op.hh"
+#include "parser.hh"
+#include "stack.hh"
+#include "tree.hh"
+#include "value-dw.hh"
+
+// Every allocation through operator new is counted.  The array and
+// sized forms are implemented in terms of these two.
+static uint64_t allocations = 0;
+
+void *
+operator new (std::size_t size)
+{
+  ++allocations;
+  if (void *ret = std::malloc (size != 0 ? size : 1))
+    return ret;
+  throw std::bad_alloc ();
+}
+
+void
+operator delete (void *ptr) noexcept
+{
+  std::free (ptr);
+}
+
+namespace
+{
+  struct catalog_entry
+  {
+    std::string name;
+    std::string query;
+  };
+
+  // Each line of a catalog is a name followed by the query.  Empty
+  // lines and lines starting with # are skipped.
+  std::vector <catalog_entry>
+  read_catalog (std::string const &fn)
+  {
+    std::ifstream ifs {fn};
+    if (! ifs)
+      throw std::runtime_error ("can't open catalog " + fn);
+
+    std::vector <catalog_entry> ret;
+    std::string line;
+    while (std::getline (ifs, line))
+      {
+	std::istringstream iss {line};
+	catalog_entry ent;
+	if (! (iss >> ent.name) || ent.name[0] == '#')
+	  continue;
+	std::getline (iss >> std::ws, ent.query);
+	ret.push_back (ent);
+      }
+    return ret;
+  }
+
+  // What a forked run sends back to the parent.
+  struct measurement
+  {
+    bool ok;
+    uint64_t results;
+    uint64_t allocations;
+    double seconds;
+    long peak_kb;
+  };
+
+  measurement
+  run_query (builtin_dict const &builtins, std::string const &fn,
+	     std::string const &str)
+  {
+    tree query = parse_query (builtins, str);
+    query.simplify ();
+    stack_shape shape;
+    shape.push (value_dwarf::vtype.code ());
+    query.peg_overloads (shape);
+    query.reduce_strength ();
+
+    // Opening the file is part of what a query costs.
+    auto start = std::chrono::steady_clock::now ();
+    uint64_t allocs = allocations;
+
+    auto stk = std::make_unique <stack> ();
+    stk->push (std::make_unique <value_dwarf> (fn, 0));
+    auto program = query.build_exec
+      (std::make_shared <op_origin> (std::move (stk)));
+
+    measurement ret {true, 0, 0, 0, 0};
+    std::vector <stack::uptr> results;
+    while (program->next_batch (results, 16) != 0)
+      {
+	ret.results += results.size ();
+	results.clear ();
+      }
+
+    std::chrono::duration <double> elapsed
+      = std::chrono::steady_clock::now () - start;
+    ret.seconds = elapsed.count ();
+    ret.allocations = allocations - allocs;
+    return ret;
+  }
+
+  // Run the query in a child process.  Errors are reported by the
+  // child, the measurement then has OK cleared.
+  measurement
+  run_forked (builtin_dict const &builtins, std::string const &fn,
+	      std::string const &query)
+  {
+    measurement ret {false, 0, 0, 0, 0};
+
+    int fds[2];
+    if (pipe (fds) != 0)
+      throw std::runtime_error ("can't create pipe");
+
+    pid_t pid = fork ();
+    if (pid < 0)
+      throw std::runtime_error ("can't fork");
+
+    if (pid == 0)
+      {
+	close (fds[0]);
+	try
+	  {
+	    ret = run_query (builtins, fn, query);
+	  }
+	catch (std::runtime_error const &e)
+	  {
+	    std::cerr << "dwgrep-bench: " << fn << ": " << query << ": "
+		      << e.what () << std::endl;
+	  }
+	if (write (fds[1], &ret, sizeof ret) != sizeof ret)
+	  _exit (1);
+	_exit (0);
+      }
+
+    close (fds[1]);
+    measurement got;
+    bool complete = read (fds[0], &got, sizeof got) == sizeof got;
+    close (fds[0]);
+
+    int status;
+    struct rusage ru;
+    if (wait4 (pid, &status, 0, &ru) != pid
+	|| ! WIFEXITED (status) || WEXITSTATUS (status) != 0 || ! complete)
+      return ret;
+
+    got.peak_kb = ru.ru_maxrss;
+    return got;
+  }
+
+  // Of REPEAT runs, keep the fastest one.
+  measurement
+  measure (builtin_dict const &builtins, std::string const &fn,
+	   std::string const &query, unsigned repeat)
+  {
+    measurement best = run_forked (builtins, fn, query);
+    for (unsigned i = 1; best.ok && i < repeat; ++i)
+      {
+	measurement m = run_forked (builtins, fn, query);
+	if (m.ok && m.seconds < best.seconds)
+	  best = m;
+      }
+    return best;
+  }
+
+  void
+  show_row (std::ostream &os, std::string const &name, uint64_t dies,
+	    measurement const &m)
+  {
+    os << std::left << std::setw (24) << name << std::right;
+    if (! m.ok)
+      {
+	os << " error\n";
+	return;
+      }
+
+    double secs = std::max (m.seconds, 1e-9);
+    os << std::fixed << std::setprecision (0)
+       << std::setw (10) << m.results
+       << std::setw (14) << dies / secs
+       << std::setw (14) << m.results / secs
+       << std::setw (10) << m.peak_kb
+       << std::setprecision (2);
+    if (m.results != 0)
+      os << std::setw (14) << (double) m.allocations / m.results;
+    else
+      os << std::setw (14) << "-";
+    os << '\n';
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  elf_version (EV_CURRENT);
+
+  unsigned repeat = 3;
+  while (true)
+    {
+      int c = getopt (argc, argv, "r:");
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'r':
+	  repeat = std::max (atoi (optarg), 1);
+	  break;
+
+	default:
+	  std::cerr << "Usage: dwgrep-bench [-r REPEAT] CATALOG FILE...\n";
+	  return 2;
+	}
+    }
+
+  if (argc - optind < 2)
+    {
+      std::cerr << "Usage: dwgrep-bench [-r REPEAT] CATALOG FILE...\n";
+      return 2;
+    }
+
+  builtin_dict builtins {*dwgrep_builtins_core (), *dwgrep_builtins_dw ()};
+  bool errors = false;
+  try
+    {
+      auto catalog = read_catalog (argv[optind]);
+      for (int i = optind + 1; i < argc; ++i)
+	{
+	  std::string fn = argv[i];
+	  measurement all = run_forked (builtins, fn, "entry");
+	  if (! all.ok)
+	    {
+	      errors = true;
+	      continue;
+	    }
+
+	  std::cout << "# " << fn << ": " << all.results << " DIEs\n"
+		    << std::left << std::setw (24) << "# query" << std::right
+		    << std::setw (10) << "results"
+		    << std::setw (14) << "DIEs/s"
+		    << std::setw (14) << "results/s"
+		    << std::setw (10) << "peak-kB"
+		    << std::setw (14) << "allocs/result" << '\n';
+
+	  for (auto const &ent: catalog)
+	    {
+	      measurement m = measure (builtins, fn, ent.query, repeat);
+	      show_row (std::cout, ent.name, all.results, m);
+	      std::cout.flush ();
+	      errors = errors || ! m.ok;
+	    }
+	}
+    }
+  catch (std::runtime_error const &e)
+    {
+      std::cerr << "dwgrep-bench: " << e.what () << std::endl;
+      return 2;
+    }
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+# Generate one translation unit of the synthetic benchmark input.
+#
+#   awk -v cu=N [-v depth=D] [-v funcs=F] [-v names=S] -f gen.awk
+#
+# Each unit has S enumerators and a number of members with long
+# unique names (many strings), structures and lexical blocks nested D
+# levels deep, template instantiations, and F functions whose
+# optimized locals end up with location lists.
+
+function sp(n,    ret)
+{
+    ret = ""
+    while (n-- > 0)
+	ret = ret " "
+    return ret
+}
+
+function nested_struct(lvl,    ind, i)
+{
+    ind = sp(lvl * 2 + 2)
+    printf "%sstruct s_%d_%d\n%s{\n", ind, cu, lvl, ind
+    for (i = 0; i < 3; ++i)
+	printf "%s  int m_%d_%d_%d_member_with_a_long_name;\n", ind, cu, lvl, i
+    if (lvl < depth)
+	{
+	    nested_struct(lvl + 1)
+	    printf "%s  s_%d_%d inner;\n", ind, cu, lvl + 1
+	}
+    printf "%s};\n", ind
+}
+
+function nested_blocks(f, lvl,    ind)
+{
+    ind = sp(lvl * 4 + 4)
+    printf "%sfor (int i%d = 0; i%d < c; ++i%d)\n%s  {\n",
+	ind, lvl, lvl, lvl, ind
+    printf "%s    int y%d = bench_sink (x + i%d);\n", ind, lvl, lvl
+    printf "%s    long z%d = (long) y%d * %d + b;\n", ind, lvl, lvl, f + 1
+    if (lvl < depth)
+	nested_blocks(f, lvl + 1)
+    printf "%s    x += bench_sink ((int) (z%d ^ y%d));\n", ind, lvl, lvl
+    printf "%s  }\n", ind
+}
+
+BEGIN {
+    if (depth == "")
+	depth = 8
+    if (funcs == "")
+	funcs = 32
+    if (names == "")
+	names = 64
+
+    print "// Generated by bench/gen.awk, do not edit."
+    print "extern int bench_sink (int);"
+    print ""
+    printf "namespace ns_%d\n{\n", cu
+
+    printf "  enum enumeration_%d\n  {\n", cu
+    for (i = 0; i < names; ++i)
+	printf "    enumerator_%d_%d_with_a_rather_long_unique_name = %d,\n",
+	    cu, i, i
+    print "  };"
+    print ""
+
+    nested_struct(0)
+    print ""
+
+    printf "  template <int N>\n  struct t_%d\n  {\n", cu
+    print "    static int get (int v) { return bench_sink (v + N); }"
+    print "  };"
+
+    for (f = 0; f < funcs; ++f)
+	{
+	    print ""
+	    printf "  int\n  f_%d_%d (int a, int b, int c, s_%d_0 *s)\n  {\n",
+		cu, f, cu
+	    printf "    int x = a * %d + b + s->m_%d_0_0_member_with_a_long_name;\n",
+		f + 3, cu
+	    nested_blocks(f, 0)
+	    printf "    return x + t_%d<%d>::get (a)\n", cu, f
+	    printf "      + enumerator_%d_%d_with_a_rather_long_unique_name;\n",
+		cu, f % names
+	    print "  }"
+	}
+
+    print "}"
+
+    if (cu == 0)
+	{
+	    print ""
+	    print "int __attribute__ ((noinline))"
+	    print "bench_sink (int v)"
+	    print "{"
+	    print "  return v * 7 + 1;"
+	    print "}"
+	}
+}
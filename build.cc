@@ -27,18 +27,58 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
+#include "builtin-cmp.hh"
+#include "builtin-cst.hh"
 #include "op.hh"
+#include "overload.hh"
+#include "profile.hh"
 #include "scope.hh"
 #include "tree.hh"
+#include "value-closure.hh"
 #include "value-cst.hh"
 #include "value-seq.hh"
 #include "value-str.hh"
 
+namespace
+{
+  // If T is a plain ?eq, ?lt or ?gt, return the cmp_result that it
+  // looks for, otherwise cmp_result::fail.
+  cmp_result
+  comparison_wanted (tree const &t)
+  {
+    if (t.tt () != tree_type::F_BUILTIN)
+      return cmp_result::fail;
+
+    auto pb = std::dynamic_pointer_cast <pred_builtin const> (t.m_builtin);
+    if (pb == nullptr || ! pb->positive ())
+      return cmp_result::fail;
+
+    if (dynamic_cast <builtin_eq const *> (pb.get ()) != nullptr)
+      return cmp_result::equal;
+    if (dynamic_cast <builtin_lt const *> (pb.get ()) != nullptr)
+      return cmp_result::less;
+    if (dynamic_cast <builtin_gt const *> (pb.get ()) != nullptr)
+      return cmp_result::greater;
+    return cmp_result::fail;
+  }
+}
+
 std::unique_ptr <pred>
 tree::build_pred () const
+{
+  if (! profile::enabled ())
+    return do_build_pred ();
+
+  profile::scope scope {*this, true};
+  return scope.wrap (do_build_pred ());
+}
+
+std::unique_ptr <pred>
+tree::do_build_pred () const
 {
   switch (m_tt)
     {
@@ -71,7 +111,8 @@ tree::build_pred () const
 	auto op2 = child (1).build_exec (origin);
 	auto pred = child (2).build_pred ();
 	return std::make_unique <pred_subx_compare> (op1, op2, origin,
-						     std::move (pred));
+						     std::move (pred),
+						     comparison_wanted (child (2)));
       }
 
     case tree_type::F_BUILTIN:
@@ -103,6 +144,17 @@ tree::build_pred () const
 
 std::shared_ptr <op>
 tree::build_exec (std::shared_ptr <op> upstream) const
+{
+  // CAT only chains ops of its children, it has none of its own.
+  if (! profile::enabled () || m_tt == tree_type::CAT)
+    return do_build_exec (upstream);
+
+  profile::scope scope {*this, false};
+  return scope.wrap (do_build_exec (upstream));
+}
+
+std::shared_ptr <op>
+tree::do_build_exec (std::shared_ptr <op> upstream) const
 {
   if (upstream == nullptr)
     upstream = std::make_shared <op_origin> (std::make_unique <stack> ());
@@ -272,3 +324,308 @@ tree::build_exec (std::shared_ptr <op> upstream) const
 
   abort ();
 }
+
+void
+tree::peg_overloads (stack_shape &shape, bool peg)
+{
+  switch (m_tt)
+    {
+    case tree_type::CAT:
+      for (auto &tree: m_children)
+	tree.peg_overloads (shape, peg);
+      return;
+
+    case tree_type::ALT:
+    case tree_type::OR:
+    case tree_type::IFELSE:
+      {
+	// Each branch starts off the same stack.  For IFELSE, the
+	// first child is the condition, whose result is thrown away.
+	size_t first = m_tt == tree_type::IFELSE ? 1 : 0;
+	stack_shape out;
+	for (size_t i = 0; i < m_children.size (); ++i)
+	  {
+	    stack_shape s = shape;
+	    child (i).peg_overloads (s, peg);
+	    if (i == first)
+	      out = s;
+	    else if (i > first)
+	      out.meet (s);
+	  }
+	shape = out;
+	return;
+      }
+
+    case tree_type::NOP:
+    case tree_type::F_DEBUG:
+      return;
+
+    case tree_type::F_BUILTIN:
+      {
+	auto bi = m_builtin;
+	if (auto ob = std::dynamic_pointer_cast <overloaded_builtin const> (bi))
+	  if (auto pegged = ob->peg (shape))
+	    bi = pegged;
+
+	if (peg)
+	  m_builtin = bi;
+	bi->update_shape (shape);
+	return;
+      }
+
+    case tree_type::ASSERT:
+    case tree_type::PRED_NOT:
+    case tree_type::PRED_AND:
+    case tree_type::PRED_OR:
+    case tree_type::PRED_SUBX_ANY:
+      // Predicates work on copies of the stack and leave the
+      // original alone.
+      for (auto &tree: m_children)
+	{
+	  stack_shape s = shape;
+	  tree.peg_overloads (s, peg);
+	}
+      return;
+
+    case tree_type::PRED_SUBX_CMP:
+      {
+	// The comparison sees results of the first expression, with
+	// TOS of the second one pushed on top.
+	stack_shape s1 = shape;
+	child (0).peg_overloads (s1, peg);
+	stack_shape s2 = shape;
+	child (1).peg_overloads (s2, peg);
+	s1.push (s2.get (0));
+	child (2).peg_overloads (s1, peg);
+	return;
+      }
+
+    case tree_type::FORMAT:
+      // Each of the interpolated expressions runs on what the
+      // previous one left behind, and its TOS is taken off.
+      for (auto &tree: m_children)
+	if (tree.m_tt != tree_type::STR)
+	  {
+	    tree.peg_overloads (shape, peg);
+	    shape.pop ();
+	  }
+      shape.push (value_str::vtype.code ());
+      return;
+
+    case tree_type::CONST:
+      shape.push (value_cst::vtype.code ());
+      return;
+
+    case tree_type::STR:
+      shape.push (value_str::vtype.code ());
+      return;
+
+    case tree_type::EMPTY_LIST:
+      shape.push (value_seq::vtype.code ());
+      return;
+
+    case tree_type::CAPTURE:
+      {
+	stack_shape s = shape;
+	child (0).peg_overloads (s, peg);
+	shape.push (value_seq::vtype.code ());
+	return;
+      }
+
+    case tree_type::SUBX_EVAL:
+      {
+	stack_shape s = shape;
+	child (0).peg_overloads (s, peg);
+	for (size_t i = cst ().value ().uval (); i-- > 0; )
+	  shape.push (s.get (i));
+	return;
+      }
+
+    case tree_type::CLOSE_STAR:
+      {
+	// Find what holds after any number of iterations, and only
+	// then peg the body.
+	stack_shape s = shape;
+	while (true)
+	  {
+	    stack_shape t = s;
+	    child (0).peg_overloads (t, false);
+	    t.meet (s);
+	    if (t == s)
+	      break;
+	    s = std::move (t);
+	  }
+
+	stack_shape t = s;
+	child (0).peg_overloads (t, peg);
+	shape = std::move (s);
+	return;
+      }
+
+    case tree_type::SCOPE:
+      child (0).peg_overloads (shape, peg);
+      return;
+
+    case tree_type::BLOCK:
+      {
+	// Nothing is known about the stack that a closure is
+	// eventually applied to.
+	stack_shape s;
+	child (0).peg_overloads (s, peg);
+	shape.push (value_closure::vtype.code ());
+	return;
+      }
+
+    case tree_type::BIND:
+      shape.pop ();
+      return;
+
+    case tree_type::READ:
+      // This might be a closure, which would be applied.
+      shape.clear ();
+      return;
+    }
+
+  abort ();
+}
+
+bool
+tree::mentions_builtin (char const *name) const
+{
+  if (m_tt == tree_type::F_BUILTIN && strcmp (m_builtin->name (), name) == 0)
+    return true;
+
+  return std::any_of (m_children.begin (), m_children.end (),
+		      [name] (tree const &ch) {
+			return ch.mentions_builtin (name);
+		      });
+}
+
+namespace
+{
+  // If T is a constant, or a builtin that pushes one, return it.
+  std::unique_ptr <value>
+  constant_value (tree const &t)
+  {
+    if (t.tt () == tree_type::CONST)
+      return std::make_unique <value_cst> (t.cst (), 0);
+
+    if (t.tt () == tree_type::F_BUILTIN)
+      if (auto bc = dynamic_cast <builtin_constant const *>
+			(t.m_builtin.get ()))
+	return bc->get_value ().clone ();
+
+    return nullptr;
+  }
+
+  // If T is an assertion ?(KEY VAL PRED), where KEY is a builtin, VAL
+  // a constant and PRED a predicate builtin, return "KEY PRED" and VAL.
+  std::unique_ptr <value>
+  match_pred_filter (tree const &t, std::string &key)
+  {
+    tree const &subx = t.child (0);
+    if (subx.child (0).tt () != tree_type::CAT
+	|| subx.child (0).m_children.size () != 3)
+      return nullptr;
+
+    tree const &k = subx.child (0).child (0);
+    tree const &p = subx.child (0).child (2);
+    if (k.tt () != tree_type::F_BUILTIN || p.tt () != tree_type::F_BUILTIN
+	|| p.m_builtin->name ()[0] != '?')
+      return nullptr;
+
+    auto val = constant_value (subx.child (0).child (1));
+    if (val != nullptr)
+      key = std::string (k.m_builtin->name ()) + " " + p.m_builtin->name ();
+    return val;
+  }
+
+  // If T is an assertion (KEY == VAL) or (VAL == KEY), where KEY is a
+  // builtin and VAL a constant, or a predicate that amounts to one,
+  // return KEY's name and VAL.  Assertions ?(KEY VAL PRED) are
+  // handled by match_pred_filter.
+  std::unique_ptr <value>
+  match_filter (tree const &t, std::string &key)
+  {
+    if (t.tt () == tree_type::F_BUILTIN)
+      return t.m_builtin->as_filter (key);
+
+    if (t.tt () == tree_type::ASSERT
+	&& t.child (0).tt () == tree_type::PRED_SUBX_ANY)
+      return match_pred_filter (t, key);
+
+    if (t.tt () != tree_type::ASSERT
+	|| t.child (0).tt () != tree_type::PRED_SUBX_CMP)
+      return nullptr;
+
+    tree const &cmp = t.child (0);
+    if (cmp.child (2).tt () != tree_type::F_BUILTIN
+	|| strcmp (cmp.child (2).m_builtin->name (), "?eq") != 0)
+      return nullptr;
+
+    for (size_t i = 0; i < 2; ++i)
+      if (cmp.child (i).tt () == tree_type::F_BUILTIN)
+	if (auto val = constant_value (cmp.child (1 - i)))
+	  {
+	    key = cmp.child (i).m_builtin->name ();
+	    return val;
+	  }
+
+    return nullptr;
+  }
+
+  // If T is a builtin that amounts to a projection, return its key
+  // and value.
+  std::unique_ptr <value>
+  match_projection (tree const &t, std::string &key)
+  {
+    if (t.tt () == tree_type::F_BUILTIN)
+      return t.m_builtin->as_projection (key);
+    return nullptr;
+  }
+
+  void
+  reduce_strength_rec (tree &t, bool pos_used)
+  {
+    for (auto &ch: t.m_children)
+      reduce_strength_rec (ch, pos_used);
+
+    if (t.tt () != tree_type::CAT)
+      return;
+
+    // A reduced builtin may take further filters, so it is offered
+    // the next one before moving on.
+    for (size_t i = 0; i + 1 < t.m_children.size (); )
+      {
+	tree &ch = t.child (i);
+	std::string key;
+	std::shared_ptr <builtin> reduced;
+	if (ch.tt () == tree_type::F_BUILTIN)
+	  {
+	    if (auto val = match_filter (t.child (i + 1), key))
+	      reduced = ch.m_builtin->reduce (key, *val, pos_used);
+	    else if (auto val = match_projection (t.child (i + 1), key))
+	      reduced = ch.m_builtin->reduce (key, *val, pos_used);
+	  }
+
+	if (reduced != nullptr)
+	  {
+	    ch.m_builtin = reduced;
+	    t.m_children.erase (t.m_children.begin () + i + 1);
+	  }
+	else
+	  ++i;
+      }
+
+    if (t.m_children.size () == 1)
+      t = t.child (0);
+  }
+}
+
+void
+tree::reduce_strength ()
+{
+  // Reduced builtins generally don't know positions of values that
+  // they produce.  That only matters if anyone asks.
+  reduce_strength_rec (*this, mentions_builtin ("pos"));
+}
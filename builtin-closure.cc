@@ -27,6 +27,7 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <iostream>
+#include <map>
 #include <memory>
 
 #include "builtin-closure.hh"
@@ -34,7 +35,17 @@
 
 struct op_apply::pimpl
 {
+  // A closure body compiled to ops.  The tree is held so that its
+  // address, which is the key, can't be reused by another tree.
+  struct compiled
+  {
+    std::shared_ptr <tree const> m_t;
+    std::shared_ptr <op_origin> m_origin;
+    std::shared_ptr <op> m_op;
+  };
+
   std::shared_ptr <op> m_upstream;
+  std::map <tree const *, compiled> m_compiled;
   std::shared_ptr <op> m_op;
   std::shared_ptr <frame> m_old_frame;
 
@@ -49,6 +60,29 @@ struct op_apply::pimpl
     m_old_frame = nullptr;
   }
 
+  // Return ops of CL's body, primed with STK.  The body is compiled
+  // once per tree and then reused.  A recursive call is handled by an
+  // op inside the body, and that has its own cache, so one body is
+  // never asked to serve two calls at once.
+  std::shared_ptr <op>
+  prime (value_closure const &cl, stack::uptr stk)
+  {
+    auto it = m_compiled.find (&cl.get_tree ());
+    if (it == m_compiled.end ())
+      {
+	auto origin = std::make_shared <op_origin> (nullptr);
+	auto op = cl.get_tree ().build_exec (origin);
+	it = m_compiled.insert (std::make_pair
+				(&cl.get_tree (),
+				 compiled {cl.get_tree_ptr (), origin, op}))
+	  .first;
+      }
+
+    it->second.m_op->reset ();
+    it->second.m_origin->set_next (std::move (stk));
+    return it->second.m_op;
+  }
+
   stack::uptr
   next ()
   {
@@ -68,8 +102,7 @@ struct op_apply::pimpl
 
 	      m_old_frame = stk->nth_frame (0);
 	      stk->set_frame (cl.get_frame ());
-	      auto origin = std::make_shared <op_origin> (std::move (stk));
-	      m_op = cl.get_tree ().build_exec (origin);
+	      m_op = prime (cl, std::move (stk));
 	    }
 	  else
 	    return nullptr;
@@ -95,6 +95,12 @@ builtin_constant::name () const
   return "constant";
 }
 
+void
+builtin_constant::update_shape (stack_shape &shape) const
+{
+  shape.push (m_value->get_type ().code ());
+}
+
 
 std::shared_ptr <op>
 builtin_hex::build_exec (std::shared_ptr <op> upstream) const
@@ -161,17 +167,33 @@ op_type::next ()
   return nullptr;
 }
 
+void
+op_type::update_shape (stack_shape &shape)
+{
+  shape.pop ();
+  shape.push (value_cst::vtype.code ());
+}
+
+numeric_constant_dom_t pos_dom_obj ("pos");
+constant_dom const &pos_dom = pos_dom_obj;
+
 stack::uptr
 op_pos::next ()
 {
   if (auto stk = m_upstream->next ())
     {
       auto vp = stk->pop ();
-      static numeric_constant_dom_t pos_dom_obj ("pos");
       stk->push (std::make_unique <value_cst>
-		(constant {vp->get_pos (), &pos_dom_obj}, 0));
+		(constant {vp->get_pos (), &pos_dom}, 0));
       return stk;
     }
 
   return nullptr;
 }
+
+void
+op_pos::update_shape (stack_shape &shape)
+{
+  shape.pop ();
+  shape.push (value_cst::vtype.code ());
+}
@@ -49,6 +49,13 @@ public:
     const override;
 
   char const *name () const override;
+  void update_shape (stack_shape &shape) const override;
+
+  value const &
+  get_value () const
+  {
+    return *m_value;
+  }
 };
 
 struct builtin_hex
@@ -92,13 +99,22 @@ class op_type
 {
   using inner_op::inner_op;
   stack::uptr next () override;
+
+public:
+  static void update_shape (stack_shape &shape);
 };
 
+// Domain of the constants that pos yields.
+extern constant_dom const &pos_dom;
+
 class op_pos
   : public inner_op
 {
   using inner_op::inner_op;
   stack::uptr next () override;
+
+public:
+  static void update_shape (stack_shape &shape);
 };
 
 #endif /* _BUILTIN_CST_H_ */
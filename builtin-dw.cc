@@ -26,6 +26,7 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <algorithm>
 #include <memory>
 #include <sstream>
 
@@ -34,6 +35,7 @@
 #include "builtin-dw.hh"
 #include "builtin.hh"
 #include "dwcst.hh"
+#include "dwindex.hh"
 #include "dwit.hh"
 #include "dwpp.hh"
 #include "known-dwarf.h"
@@ -51,6 +53,7 @@ namespace
   struct op_dwopen_str
     : public op_overload <value_str>
   {
+    typedef value_dwarf result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -61,88 +64,892 @@ namespace
   };
 }
 
+// Unit enumeration shared by entry and unit.
+namespace
+{
+  bool
+  maybe_next_module (dwfl_module_iterator &modit, cu_iterator &cuit)
+  {
+    while (cuit == cu_iterator::end ())
+      {
+	if (modit == dwfl_module_iterator::end ())
+	  return false;
+
+	Dwarf *dw = (*modit++).first;
+	assert (dw != nullptr);
+	cuit = cu_iterator (dw);
+      }
+
+    return true;
+  }
+
+  // Iterates units of all modules of a Dwarf, skipping units that
+  // fall outside the range that the Dwarf was restricted to.
+  struct unit_range_iterator
+  {
+    dwfl_module_iterator m_modit;
+    cu_iterator m_cuit;
+    size_t m_i;
+    size_t m_end;
+
+    explicit unit_range_iterator (value_dwarf &vdw)
+      : m_modit {vdw.get_dwctx ()->get_dwfl ()}
+      , m_cuit {cu_iterator::end ()}
+      , m_i {0}
+      , m_end {vdw.get_unit_end ()}
+    {
+      while (m_i < vdw.get_unit_begin () && maybe_next_module (m_modit, m_cuit))
+	{
+	  ++m_cuit;
+	  ++m_i;
+	}
+    }
+
+    // Makes M_CUIT point at the next unit to visit, if any.  Call
+    // advance after the unit has been used up.
+    bool
+    valid ()
+    {
+      return m_i < m_end && maybe_next_module (m_modit, m_cuit);
+    }
+
+    void
+    advance ()
+    {
+      ++m_cuit;
+      ++m_i;
+    }
+  };
+
+  // Look for a DIE at offset OFF in the unit that CUIT points at.
+  // DIE offsets nest the same way that DIEs themselves do, so only
+  // the ancestors of the sought-after DIE and their preceding
+  // siblings need to be visited.
+  bool
+  find_die_in_unit (cu_iterator &cuit, Dwarf_Off off, Dwarf_Die &ret)
+  {
+    Dwarf_Die die = **cuit;
+    Dwarf_Off next;
+    size_t hsize;
+    if (off < dwarf_dieoffset (&die)
+	|| dwarf_nextcu (dwarf_cu_getdwarf (die.cu), cuit.offset (), &next,
+			 &hsize, nullptr, nullptr, nullptr) != 0
+	|| off >= next)
+      return false;
+
+    while (dwarf_dieoffset (&die) != off)
+      {
+	Dwarf_Die child;
+	if (! dwarf_haschildren (&die))
+	  return false;
+	if (dwarf_child (&die, &child) != 0)
+	  throw_libdw ();
+	if (dwarf_dieoffset (&child) > off)
+	  return false;
+
+	// Find the last child that starts at or before OFF.
+	Dwarf_Die sibling;
+	int rc;
+	while ((rc = dwarf_siblingof (&child, &sibling)) == 0
+	       && dwarf_dieoffset (&sibling) <= off)
+	  child = sibling;
+	if (rc == -1)
+	  throw_libdw ();
+
+	die = child;
+      }
+
+    ret = die;
+    return true;
+  }
+
+  // Same as above, but consult DIE index of the Dwarf, if any.
+  bool
+  find_die_in_unit (dwfl_context &dwctx, cu_iterator &cuit, Dwarf_Off off,
+		    Dwarf_Die &ret)
+  {
+    Dwarf *dw = dwarf_cu_getdwarf ((**cuit).cu);
+    if (die_index const *idx = dwctx.find_index (dw))
+      if (auto u = idx->find_unit (cuit.offset ()))
+	{
+	  auto it = std::lower_bound
+	    (idx->begin (*u), idx->end (*u), off,
+	     [] (die_index::die_rec const &rec, Dwarf_Off off)
+	     { return rec.offset < off; });
+	  if (it == idx->end (*u) || it->offset != off)
+	    return false;
+	  if (dwarf_offdie (dw, off, &ret) == nullptr)
+	    throw_libdw ();
+	  return true;
+	}
+
+    return find_die_in_unit (cuit, off, ret);
+  }
+
+  // Enumerates DIEs of one unit in pre-order.  When the Dwarf has a
+  // DIE index, the index records are walked instead of the DIE tree.
+  // If a tag is given, only DIEs with that tag are yielded, and if an
+  // attribute name is given, only DIEs that have that attribute.
+  struct unit_dies
+  {
+    die_walker m_walker;
+    dwfl_context *m_dwctx;
+    Dwarf *m_dw;
+    die_index::die_rec const *m_rec;
+    die_index::die_rec const *m_rec_end;
+    int m_tag;
+    unsigned m_atname;
+
+    explicit unit_dies (int tag = -1, unsigned atname = 0)
+      : m_dwctx {nullptr}
+      , m_dw {nullptr}
+      , m_rec {nullptr}
+      , m_rec_end {nullptr}
+      , m_tag {tag}
+      , m_atname {atname}
+    {}
+
+    bool
+    has_atname (Dwarf_Die &die)
+    {
+      return m_atname == 0 || m_dwctx->has_attr (die, m_atname);
+    }
+
+    void
+    reset (dwfl_context &dwctx, cu_iterator cuit)
+    {
+      m_dwctx = &dwctx;
+      m_dw = dwarf_cu_getdwarf ((**cuit).cu);
+      die_index const *idx = dwctx.find_index (m_dw);
+      if (auto u = idx != nullptr ? idx->find_unit (cuit.offset ()) : nullptr)
+	{
+	  m_rec = idx->begin (*u);
+	  m_rec_end = idx->end (*u);
+	}
+      else
+	{
+	  m_rec = m_rec_end = nullptr;
+	  m_walker.reset (**cuit);
+	}
+    }
+
+    // Set RET to the next DIE and PARENT to the offset of its parent
+    // (or value_die::no_parent), and return true, or return false if
+    // the unit is exhausted.  DIEs that are skipped by the filters
+    // are counted in SKIPPED, so that callers can keep positions that
+    // a full enumeration would have.
+    bool
+    next (Dwarf_Die &ret, Dwarf_Off &parent, size_t &skipped)
+    {
+      if (m_rec != m_rec_end)
+	{
+	  for (; m_rec != m_rec_end; ++m_rec)
+	    if (m_tag == -1 || (int) m_rec->tag == m_tag)
+	      {
+		if (dwarf_offdie (m_dw, m_rec->offset, &ret) == nullptr)
+		  throw_libdw ();
+		if (! has_atname (ret))
+		  {
+		    ++skipped;
+		    continue;
+		  }
+		parent = m_rec->parent == die_index::no_off
+		  ? value_die::no_parent : m_rec->parent;
+		++m_rec;
+		return true;
+	      }
+	    else
+	      ++skipped;
+
+	  return false;
+	}
+
+      while (Dwarf_Die *die = m_walker.next ())
+	if ((m_tag == -1 || dwarf_tag (die) == m_tag) && has_atname (*die))
+	  {
+	    ret = *die;
+	    Dwarf_Die *par = m_walker.parent ();
+	    parent = par != nullptr
+	      ? dwarf_dieoffset (par) : value_die::no_parent;
+	    return true;
+	  }
+	else
+	  ++skipped;
+
+      return false;
+    }
+  };
+}
+
+// DIEs of a unit that cover a given address, as found in the address
+// index of the context.  Used by the address forms of entry.
+namespace
+{
+  mpz_class addressify (constant c);
+
+  struct address_dies
+  {
+    Dwarf *m_dw;
+    std::vector <Dwarf_Off> m_offs;
+    size_t m_i;
+
+    address_dies ()
+      : m_dw {nullptr}
+      , m_i {0}
+    {}
+
+    void
+    reset (dwfl_context &dwctx, Dwarf_Die cudie, Dwarf_Addr addr, int tag)
+    {
+      m_dw = dwarf_cu_getdwarf (cudie.cu);
+      m_offs = dwctx.find_dies_at (cudie, addr, tag);
+      m_i = 0;
+    }
+
+    bool
+    next (Dwarf_Die &ret)
+    {
+      if (m_i == m_offs.size ())
+	return false;
+      if (dwarf_offdie (m_dw, m_offs[m_i++], &ret) == nullptr)
+	throw_libdw ();
+      return true;
+    }
+  };
+}
+
 // entry
 namespace
 {
+  // Values of attribute ATNAME at DIEs that Dies::next_die yields.
+  // This is entry fused with a following @AT_x: no value is made for
+  // the DIEs, and no stack for those that have the attribute.
+  template <class Dies>
+  struct entry_atval_producer
+    : public value_producer
+  {
+    Dies m_dies;
+    unsigned m_atname;
+    std::unique_ptr <value_producer> m_values;
+
+    template <class... Args>
+    explicit entry_atval_producer (unsigned atname, Args &&... args)
+      : m_dies {std::forward <Args> (args)...}
+      , m_atname {atname}
+    {}
+
+    std::unique_ptr <value>
+    next () override
+    {
+      while (true)
+	{
+	  if (m_values != nullptr)
+	    if (auto v = m_values->next ())
+	      return v;
+
+	  Dwarf_Die die;
+	  Dwarf_Off parent;
+	  if (! m_dies.next_die (die, parent))
+	    return nullptr;
+
+	  Dwarf_Attribute attr;
+	  if (dwarf_attr (&die, m_atname, &attr) == nullptr)
+	    m_values = nullptr;
+	  else
+	    m_values = at_value (m_dies.m_dwctx, die, attr);
+	}
+    }
+  };
+
   struct op_entry_dwarf
     : public op_yielding_overload <value_dwarf>
   {
-    struct producer
-      : public value_producer
+    typedef value_die result_type;
+    struct producer
+      : public value_producer
+    {
+      dwctx_ptr m_dwctx;
+      unit_range_iterator m_units;
+      unit_dies m_dies;
+      size_t m_i;
+
+      producer (value_dwarf &vdw, int tag, unsigned atname)
+	: m_dwctx {(assert (vdw.get_dwctx () != nullptr), vdw.get_dwctx ())}
+	, m_units {vdw}
+	, m_dies {tag, atname}
+	, m_i {0}
+      {}
+
+      bool
+      next_die (Dwarf_Die &die, Dwarf_Off &parent)
+      {
+	while (! m_dies.next (die, parent, m_i))
+	  {
+	    if (! m_units.valid ())
+	      return false;
+
+	    m_dies.reset (*m_dwctx, m_units.m_cuit);
+	    m_units.advance ();
+	  }
+
+	return true;
+      }
+
+      std::unique_ptr <value>
+      next () override
+      {
+	Dwarf_Die die;
+	Dwarf_Off parent;
+	if (! next_die (die, parent))
+	  return nullptr;
+
+	return std::make_unique <value_die> (m_dwctx, die, m_i++, parent);
+      }
+    };
+
+    // Tag that DIEs are filtered by, or -1, and name of an attribute
+    // that they need to have, or 0.
+    int m_tag;
+    unsigned m_atname;
+
+    explicit op_entry_dwarf (std::shared_ptr <op> upstream, int tag = -1,
+			     unsigned atname = 0)
+      : op_yielding_overload {upstream}
+      , m_tag {tag}
+      , m_atname {atname}
+    {}
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_dwarf> a) override
+    {
+      return std::make_unique <producer> (*a, m_tag, m_atname);
+    }
+
+    static bool
+    splits_by_unit ()
+    {
+      return true;
+    }
+
+    static std::shared_ptr <builtin> reduce (std::string const &key,
+					     value const &val, bool pos_used);
+  };
+
+  // entry (offset == OFF) over a Dwarf.  The DIE is looked up instead
+  // of enumerated, so its position is unknown.
+  struct op_entry_offset_dwarf
+    : public op_yielding_overload <value_dwarf>
+  {
+    Dwarf_Off m_offset;
+
+    op_entry_offset_dwarf (std::shared_ptr <op> upstream, Dwarf_Off offset)
+      : op_yielding_overload {upstream}
+      , m_offset {offset}
+    {}
+
+    struct producer
+      : public value_producer
+    {
+      dwctx_ptr m_dwctx;
+      unit_range_iterator m_units;
+      Dwarf_Off m_offset;
+
+      producer (value_dwarf &vdw, Dwarf_Off offset)
+	: m_dwctx {vdw.get_dwctx ()}
+	, m_units {vdw}
+	, m_offset {offset}
+      {}
+
+      std::unique_ptr <value>
+      next () override
+      {
+	// Each module has its own offset space, so there may be a DIE
+	// at M_OFFSET in more than one unit.
+	while (m_units.valid ())
+	  {
+	    Dwarf_Die die;
+	    bool found = find_die_in_unit (*m_dwctx, m_units.m_cuit,
+					   m_offset, die);
+	    m_units.advance ();
+	    if (found)
+	      return std::make_unique <value_die> (m_dwctx, die, 0);
+	  }
+
+	return nullptr;
+      }
+    };
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_dwarf> a) override
+    {
+      return std::make_unique <producer> (*a, m_offset);
+    }
+
+    static bool
+    splits_by_unit ()
+    {
+      return true;
+    }
+  };
+
+  // DIEs of a Dwarf whose address ranges cover ADDR, optionally also
+  // filtered by tag.  Rather than computing address sets of all DIEs,
+  // the address index of the context is consulted.  DIEs are numbered
+  // in the order that they are found, which is not their position in
+  // entry.
+  struct entry_address_producer
+    : public value_producer
+  {
+    dwctx_ptr m_dwctx;
+    unit_range_iterator m_units;
+    address_dies m_dies;
+    Dwarf_Addr m_addr;
+    int m_tag;
+    size_t m_i;
+
+    entry_address_producer (value_dwarf &vdw, Dwarf_Addr addr, int tag)
+      : m_dwctx {vdw.get_dwctx ()}
+      , m_units {vdw}
+      , m_addr {addr}
+      , m_tag {tag}
+      , m_i {0}
+    {}
+
+    std::unique_ptr <value>
+    next () override
+    {
+      Dwarf_Die die;
+      while (! m_dies.next (die))
+	{
+	  if (! m_units.valid ())
+	    return nullptr;
+
+	  m_dies.reset (*m_dwctx, **m_units.m_cuit, m_addr, m_tag);
+	  m_units.advance ();
+	}
+
+      return std::make_unique <value_die> (m_dwctx, die, m_i++);
+    }
+  };
+
+  // entry ?(address ADDR ?contains) over a Dwarf, optionally also
+  // filtered by tag.
+  struct op_entry_address_dwarf
+    : public op_yielding_overload <value_dwarf>
+  {
+    Dwarf_Addr m_addr;
+    int m_tag;
+
+    op_entry_address_dwarf (std::shared_ptr <op> upstream,
+			    Dwarf_Addr addr, int tag)
+      : op_yielding_overload {upstream}
+      , m_addr {addr}
+      , m_tag {tag}
+    {}
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_dwarf> a) override
+    {
+      return std::make_unique <entry_address_producer> (*a, m_addr, m_tag);
+    }
+
+    static bool
+    splits_by_unit ()
+    {
+      return true;
+    }
+
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    Dwarf_Addr addr, int tag)
+    {
+      uint64_t n;
+      if (tag == -1 && key == "label" && pinned_constant (val, dw_tag_dom, n))
+	return make_overload_op_builtin <op_entry_address_dwarf>
+	  (addr, (int) n);
+      return nullptr;
+    }
+  };
+
+  // DW ADDR entry -- DIEs of DW whose address ranges cover ADDR.
+  struct op_entry_dwarf_cst
+    : public op_yielding_overload <value_dwarf, value_cst>
+  {
+    typedef value_die result_type;
+
+    // Tag that DIEs are filtered by, or -1.
+    int m_tag;
+
+    explicit op_entry_dwarf_cst (std::shared_ptr <op> upstream, int tag = -1)
+      : op_yielding_overload {upstream}
+      , m_tag {tag}
+    {}
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_dwarf> a,
+	     std::unique_ptr <value_cst> b) override
+    {
+      auto addr = addressify (b->get_constant ());
+      return std::make_unique <entry_address_producer>
+	(*a, addr.uval (), m_tag);
+    }
+
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used)
+    {
+      uint64_t n;
+      if (! pos_used && key == "label"
+	  && pinned_constant (val, dw_tag_dom, n))
+	return make_overload_op_builtin <op_entry_dwarf_cst> ((int) n);
+      return nullptr;
+    }
+
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    int tag)
+    {
+      return nullptr;
+    }
+  };
+
+  // entry ?TAG over a Dwarf.  DIEs with other tags are skipped
+  // before a value is made for them.  Positions are those that the
+  // DIEs would have had without the filter.
+  struct op_entry_tag_dwarf
+    : public op_entry_dwarf
+  {
+    using op_entry_dwarf::op_entry_dwarf;
+
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    int tag);
+  };
+
+  // entry @AT_x over a Dwarf, possibly after filters by tag and
+  // attribute.  Having the attribute that is fetched is a filter in
+  // itself, so DIEs that lack it are skipped by its abbreviation too.
+  struct op_entry_atval_dwarf
+    : public op_yielding_overload <value_dwarf>
+  {
+    int m_tag;
+    unsigned m_atname;
+    unsigned m_valname;
+
+    op_entry_atval_dwarf (std::shared_ptr <op> upstream, int tag,
+			  unsigned atname, unsigned valname)
+      : op_yielding_overload {upstream}
+      , m_tag {tag}
+      , m_atname {atname}
+      , m_valname {valname}
+    {}
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_dwarf> a) override
+    {
+      return std::make_unique
+	<entry_atval_producer <op_entry_dwarf::producer>>
+	(m_valname, *a, m_tag, m_atname != 0 ? m_atname : m_valname);
+    }
+
+    static bool
+    splits_by_unit ()
+    {
+      return true;
+    }
+  };
+
+  // entry ?AT_x over a Dwarf, possibly also filtered by tag.  DIEs
+  // whose abbreviation lacks the attribute are skipped.
+  struct op_entry_attr_dwarf
+    : public op_entry_dwarf
+  {
+    using op_entry_dwarf::op_entry_dwarf;
+
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    int tag, unsigned atname)
+    {
+      uint64_t n;
+      if (tag == -1 && key == "label" && pinned_constant (val, dw_tag_dom, n))
+	return make_overload_op_builtin <op_entry_attr_dwarf>
+	  ((int) n, atname);
+      if (key == "@AT" && pinned_constant (val, dw_attr_dom, n))
+	return make_overload_op_builtin <op_entry_atval_dwarf>
+	  (tag, atname, (unsigned) n);
+      return nullptr;
+    }
+  };
+
+  // Only the address lookup and the attribute filter compose with
+  // the tag filter.
+  std::shared_ptr <builtin>
+  op_entry_tag_dwarf::reduce (std::string const &key, value const &val,
+			      bool pos_used, int tag)
+  {
+    uint64_t n;
+    if (! pos_used && key == "address ?contains"
+	&& pinned_constant (val, dw_address_dom, n))
+      return make_overload_op_builtin <op_entry_address_dwarf> (n, tag);
+    if (key == "?AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_attr_dwarf>
+	(tag, (unsigned) n);
+    if (key == "@AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_atval_dwarf>
+	(tag, 0u, (unsigned) n);
+    return nullptr;
+  }
+
+  std::shared_ptr <builtin>
+  op_entry_dwarf::reduce (std::string const &key, value const &val,
+			  bool pos_used)
+  {
+    uint64_t n;
+    if (! pos_used && key == "offset"
+	&& pinned_constant (val, dw_offset_dom, n))
+      return make_overload_op_builtin <op_entry_offset_dwarf> (n);
+    if (key == "label" && pinned_constant (val, dw_tag_dom, n))
+      return make_overload_op_builtin <op_entry_tag_dwarf> ((int) n);
+    if (! pos_used && key == "address ?contains"
+	&& pinned_constant (val, dw_address_dom, n))
+      return make_overload_op_builtin <op_entry_address_dwarf> (n, -1);
+    if (key == "?AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_attr_dwarf>
+	(-1, (unsigned) n);
+    if (key == "@AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_atval_dwarf>
+	(-1, 0u, (unsigned) n);
+    return nullptr;
+  }
+
+  struct op_entry_cu
+    : public op_yielding_overload <value_cu>
+  {
+    typedef value_die result_type;
+
+    // Tag that DIEs are filtered by, or -1, and name of an attribute
+    // that they need to have, or 0.
+    int m_tag;
+    unsigned m_atname;
+
+    explicit op_entry_cu (std::shared_ptr <op> upstream, int tag = -1,
+			  unsigned atname = 0)
+      : op_yielding_overload {upstream}
+      , m_tag {tag}
+      , m_atname {atname}
+    {}
+
+    struct producer
+      : public value_producer
+    {
+      dwctx_ptr m_dwctx;
+      unit_dies m_dies;
+      size_t m_i;
+
+      producer (dwctx_ptr dwctx, Dwarf_Die cudie, int tag, unsigned atname)
+	: m_dwctx {dwctx}
+	, m_dies {tag, atname}
+	, m_i {0}
+      {
+	Dwarf *dw = dwarf_cu_getdwarf (cudie.cu);
+	m_dies.reset (*m_dwctx, cu_iterator {dw, cudie});
+      }
+
+      bool
+      next_die (Dwarf_Die &die, Dwarf_Off &parent)
+      {
+	return m_dies.next (die, parent, m_i);
+      }
+
+      std::unique_ptr <value>
+      next () override
+      {
+	Dwarf_Die die;
+	Dwarf_Off parent;
+	if (! next_die (die, parent))
+	  return nullptr;
+
+	return std::make_unique <value_die> (m_dwctx, die, m_i++, parent);
+      }
+    };
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_cu> a) override
+    {
+      Dwarf_Die cudie;
+      if (dwarf_cu_die (&a->get_cu (), &cudie, nullptr, nullptr,
+			nullptr, nullptr, nullptr, nullptr) == nullptr)
+	throw_libdw ();
+
+      return std::make_unique <producer> (a->get_dwctx (), cudie,
+					  m_tag, m_atname);
+    }
+
+    static std::shared_ptr <builtin> reduce (std::string const &key,
+					     value const &val, bool pos_used);
+  };
+
+  // entry (offset == OFF) over a unit.
+  struct op_entry_offset_cu
+    : public op_yielding_overload <value_cu>
+  {
+    Dwarf_Off m_offset;
+
+    op_entry_offset_cu (std::shared_ptr <op> upstream, Dwarf_Off offset)
+      : op_yielding_overload {upstream}
+      , m_offset {offset}
+    {}
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_cu> a) override
+    {
+      Dwarf_Die cudie;
+      if (dwarf_cu_die (&a->get_cu (), &cudie, nullptr, nullptr,
+			nullptr, nullptr, nullptr, nullptr) == nullptr)
+	throw_libdw ();
+
+      cu_iterator cuit {dwarf_cu_getdwarf (cudie.cu), cudie};
+      Dwarf_Die die;
+      if (! find_die_in_unit (*a->get_dwctx (), cuit, m_offset, die))
+	return nullptr;
+
+      return std::make_unique <value_producer_single>
+	(std::make_unique <value_die> (a->get_dwctx (), die, 0));
+    }
+  };
+
+  // DIEs of a unit whose address ranges cover ADDR, optionally also
+  // filtered by tag.  Numbered as in entry_address_producer.
+  struct entry_address_cu_producer
+    : public value_producer
+  {
+    dwctx_ptr m_dwctx;
+    address_dies m_dies;
+    size_t m_i;
+
+    entry_address_cu_producer (value_cu &vcu, Dwarf_Addr addr, int tag)
+      : m_dwctx {vcu.get_dwctx ()}
+      , m_i {0}
     {
-      std::shared_ptr <dwfl_context> m_dwctx;
-      dwfl_module_iterator m_modit;
-      all_dies_iterator m_it;
-      size_t m_i;
+      Dwarf_Die cudie;
+      if (dwarf_cu_die (&vcu.get_cu (), &cudie, nullptr, nullptr,
+			nullptr, nullptr, nullptr, nullptr) == nullptr)
+	throw_libdw ();
 
-      producer (std::shared_ptr <dwfl_context> dwctx)
-	: m_dwctx {(assert (dwctx != nullptr), dwctx)}
-	, m_modit {m_dwctx->get_dwfl ()}
-	, m_it {all_dies_iterator::end ()}
-	, m_i {0}
-      {}
+      m_dies.reset (*m_dwctx, cudie, addr, tag);
+    }
 
-      std::unique_ptr <value>
-      next () override
-      {
-	if (m_it == all_dies_iterator::end ())
-	  {
-	    if (m_modit == dwfl_module_iterator::end ())
-	      return nullptr;
+    std::unique_ptr <value>
+    next () override
+    {
+      Dwarf_Die die;
+      if (! m_dies.next (die))
+	return nullptr;
 
-	    auto ret = *m_modit++;
-	    assert (ret.first != nullptr);
-	    m_it = all_dies_iterator (ret.first);
-	  }
+      return std::make_unique <value_die> (m_dwctx, die, m_i++);
+    }
+  };
 
-	return std::make_unique <value_die> (m_dwctx, **m_it++, m_i++);
-      }
-    };
+  // entry ?(address ADDR ?contains) over a unit, optionally also
+  // filtered by tag.
+  struct op_entry_address_cu
+    : public op_yielding_overload <value_cu>
+  {
+    Dwarf_Addr m_addr;
+    int m_tag;
 
-    using op_yielding_overload::op_yielding_overload;
+    op_entry_address_cu (std::shared_ptr <op> upstream,
+			 Dwarf_Addr addr, int tag)
+      : op_yielding_overload {upstream}
+      , m_addr {addr}
+      , m_tag {tag}
+    {}
 
     std::unique_ptr <value_producer>
-    operate (std::unique_ptr <value_dwarf> a) override
+    operate (std::unique_ptr <value_cu> a) override
     {
-      return std::make_unique <producer> (a->get_dwctx ());
+      return std::make_unique <entry_address_cu_producer>
+	(*a, m_addr, m_tag);
+    }
+
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    Dwarf_Addr addr, int tag)
+    {
+      uint64_t n;
+      if (tag == -1 && key == "label" && pinned_constant (val, dw_tag_dom, n))
+	return make_overload_op_builtin <op_entry_address_cu> (addr, (int) n);
+      return nullptr;
     }
   };
 
-  struct op_entry_cu
-    : public op_yielding_overload <value_cu>
+  // CU ADDR entry -- DIEs of CU whose address ranges cover ADDR.
+  struct op_entry_cu_cst
+    : public op_yielding_overload <value_cu, value_cst>
   {
-    using op_yielding_overload::op_yielding_overload;
+    typedef value_die result_type;
 
-    struct producer
-      : public value_producer
+    // Tag that DIEs are filtered by, or -1.
+    int m_tag;
+
+    explicit op_entry_cu_cst (std::shared_ptr <op> upstream, int tag = -1)
+      : op_yielding_overload {upstream}
+      , m_tag {tag}
+    {}
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_cu> a,
+	     std::unique_ptr <value_cst> b) override
     {
-      std::shared_ptr <dwfl_context> m_dwctx;
-      all_dies_iterator m_it;
-      all_dies_iterator m_end;
-      size_t m_i;
+      auto addr = addressify (b->get_constant ());
+      return std::make_unique <entry_address_cu_producer>
+	(*a, addr.uval (), m_tag);
+    }
 
-      producer (std::shared_ptr <dwfl_context> dwctx, Dwarf_Die cudie)
-	: m_dwctx {dwctx}
-	, m_it {all_dies_iterator::end ()}
-	, m_end {all_dies_iterator::end ()}
-	, m_i {0}
-      {
-	Dwarf *dw = dwarf_cu_getdwarf (cudie.cu);
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used)
+    {
+      uint64_t n;
+      if (! pos_used && key == "label"
+	  && pinned_constant (val, dw_tag_dom, n))
+	return make_overload_op_builtin <op_entry_cu_cst> ((int) n);
+      return nullptr;
+    }
 
-	cu_iterator cuit {dw, cudie};
-	m_it = all_dies_iterator (cuit);
-	m_end = all_dies_iterator (++cuit);
-      }
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    int tag)
+    {
+      return nullptr;
+    }
+  };
 
-      std::unique_ptr <value>
-      next () override
-      {
-	if (m_it == m_end)
-	  return nullptr;
+  // entry ?TAG over a unit.
+  struct op_entry_tag_cu
+    : public op_entry_cu
+  {
+    using op_entry_cu::op_entry_cu;
 
-	return std::make_unique <value_die> (m_dwctx, **m_it++, m_i++);
-      }
-    };
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    int tag);
+  };
+
+  // entry @AT_x over a unit, possibly after filters by tag and
+  // attribute.
+  struct op_entry_atval_cu
+    : public op_yielding_overload <value_cu>
+  {
+    int m_tag;
+    unsigned m_atname;
+    unsigned m_valname;
+
+    op_entry_atval_cu (std::shared_ptr <op> upstream, int tag,
+		       unsigned atname, unsigned valname)
+      : op_yielding_overload {upstream}
+      , m_tag {tag}
+      , m_atname {atname}
+      , m_valname {valname}
+    {}
 
     std::unique_ptr <value_producer>
     operate (std::unique_ptr <value_cu> a) override
@@ -152,19 +959,79 @@ namespace
 			nullptr, nullptr, nullptr, nullptr) == nullptr)
 	throw_libdw ();
 
-      return std::make_unique <producer> (a->get_dwctx (), cudie);
+      return std::make_unique <entry_atval_producer <op_entry_cu::producer>>
+	(m_valname, a->get_dwctx (), cudie,
+	 m_tag, m_atname != 0 ? m_atname : m_valname);
+    }
+  };
+
+  // entry ?AT_x over a unit, possibly also filtered by tag.
+  struct op_entry_attr_cu
+    : public op_entry_cu
+  {
+    using op_entry_cu::op_entry_cu;
+
+    static std::shared_ptr <builtin>
+    reduce (std::string const &key, value const &val, bool pos_used,
+	    int tag, unsigned atname)
+    {
+      uint64_t n;
+      if (tag == -1 && key == "label" && pinned_constant (val, dw_tag_dom, n))
+	return make_overload_op_builtin <op_entry_attr_cu> ((int) n, atname);
+      if (key == "@AT" && pinned_constant (val, dw_attr_dom, n))
+	return make_overload_op_builtin <op_entry_atval_cu>
+	  (tag, atname, (unsigned) n);
+      return nullptr;
     }
   };
 
+  std::shared_ptr <builtin>
+  op_entry_tag_cu::reduce (std::string const &key, value const &val,
+			   bool pos_used, int tag)
+  {
+    uint64_t n;
+    if (! pos_used && key == "address ?contains"
+	&& pinned_constant (val, dw_address_dom, n))
+      return make_overload_op_builtin <op_entry_address_cu> (n, tag);
+    if (key == "?AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_attr_cu> (tag, (unsigned) n);
+    if (key == "@AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_atval_cu>
+	(tag, 0u, (unsigned) n);
+    return nullptr;
+  }
+
+  std::shared_ptr <builtin>
+  op_entry_cu::reduce (std::string const &key, value const &val,
+		       bool pos_used)
+  {
+    uint64_t n;
+    if (! pos_used && key == "offset"
+	&& pinned_constant (val, dw_offset_dom, n))
+      return make_overload_op_builtin <op_entry_offset_cu> (n);
+    if (key == "label" && pinned_constant (val, dw_tag_dom, n))
+      return make_overload_op_builtin <op_entry_tag_cu> ((int) n);
+    if (! pos_used && key == "address ?contains"
+	&& pinned_constant (val, dw_address_dom, n))
+      return make_overload_op_builtin <op_entry_address_cu> (n, -1);
+    if (key == "?AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_attr_cu> (-1, (unsigned) n);
+    if (key == "@AT" && pinned_constant (val, dw_attr_dom, n))
+      return make_overload_op_builtin <op_entry_atval_cu>
+	(-1, 0u, (unsigned) n);
+    return nullptr;
+  }
+
   struct op_entry_abbrev_unit
     : public op_yielding_overload <value_abbrev_unit>
   {
+    typedef value_abbrev result_type;
     using op_yielding_overload::op_yielding_overload;
 
     struct producer
       : public value_producer
     {
-      std::shared_ptr <dwfl_context> m_dwctx;
+      dwctx_ptr m_dwctx;
       std::vector <Dwarf_Abbrev *> m_abbrevs;
       Dwarf_Die m_cudie;
       Dwarf_Off m_offset;
@@ -206,64 +1073,122 @@ namespace
 // unit
 namespace
 {
-  bool
-  maybe_next_module (dwfl_module_iterator &modit, cu_iterator &cuit)
+  struct op_unit_dwarf
+    : public op_yielding_overload <value_dwarf>
   {
-    while (cuit == cu_iterator::end ())
+    typedef value_cu result_type;
+    using op_yielding_overload::op_yielding_overload;
+
+    struct producer
+      : public value_producer
+    {
+      dwctx_ptr m_dwctx;
+      unit_range_iterator m_units;
+
+      producer (value_dwarf &vdw)
+	: m_dwctx {vdw.get_dwctx ()}
+	, m_units {vdw}
+      {}
+
+      std::unique_ptr <value>
+      next () override
       {
-	if (modit == dwfl_module_iterator::end ())
-	  return false;
+	if (! m_units.valid ())
+	  return nullptr;
 
-	Dwarf *dw = (*modit++).first;
-	assert (dw != nullptr);
-	cuit = cu_iterator (dw);
+	auto &cuit = m_units.m_cuit;
+	auto ret = std::make_unique <value_cu>
+	  (m_dwctx, *(*cuit)->cu, cuit.offset (), m_units.m_i);
+	m_units.advance ();
+	return std::move (ret);
       }
+    };
 
-    return true;
-  }
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_dwarf> a) override
+    {
+      return std::make_unique <producer> (*a);
+    }
 
-  struct op_unit_dwarf
+    static bool
+    splits_by_unit ()
+    {
+      return true;
+    }
+
+    static std::shared_ptr <builtin> reduce (std::string const &key,
+					     value const &val, bool pos_used);
+  };
+
+  // unit (offset == OFF) over a Dwarf.  Only unit headers are walked,
+  // no values are created for units that don't match.
+  struct op_unit_offset_dwarf
     : public op_yielding_overload <value_dwarf>
   {
-    using op_yielding_overload::op_yielding_overload;
+    Dwarf_Off m_offset;
+
+    op_unit_offset_dwarf (std::shared_ptr <op> upstream, Dwarf_Off offset)
+      : op_yielding_overload {upstream}
+      , m_offset {offset}
+    {}
 
     struct producer
       : public value_producer
     {
-      std::shared_ptr <dwfl_context> m_dwctx;
-      dwfl_module_iterator m_modit;
-      cu_iterator m_cuit;
-      size_t m_i;
+      dwctx_ptr m_dwctx;
+      unit_range_iterator m_units;
+      Dwarf_Off m_offset;
 
-      producer (std::shared_ptr <dwfl_context> dwctx)
-	: m_dwctx {dwctx}
-	, m_modit {m_dwctx->get_dwfl ()}
-	, m_cuit {cu_iterator::end ()}
-	, m_i {0}
+      producer (value_dwarf &vdw, Dwarf_Off offset)
+	: m_dwctx {vdw.get_dwctx ()}
+	, m_units {vdw}
+	, m_offset {offset}
       {}
 
       std::unique_ptr <value>
       next () override
       {
-	if (! maybe_next_module (m_modit, m_cuit))
-	  return nullptr;
+	for (; m_units.valid (); m_units.advance ())
+	  {
+	    auto &cuit = m_units.m_cuit;
+	    if (cuit.offset () == m_offset)
+	      {
+		auto ret = std::make_unique <value_cu>
+		  (m_dwctx, *(*cuit)->cu, cuit.offset (), m_units.m_i);
+		m_units.advance ();
+		return std::move (ret);
+	      }
+	  }
 
-	auto ret = std::make_unique <value_cu>
-	  (m_dwctx, *(*m_cuit)->cu, m_cuit.offset (), m_i++);
-	m_cuit++;
-	return std::move (ret);
+	return nullptr;
       }
     };
 
     std::unique_ptr <value_producer>
     operate (std::unique_ptr <value_dwarf> a) override
     {
-      return std::make_unique <producer> (a->get_dwctx ());
+      return std::make_unique <producer> (*a, m_offset);
+    }
+
+    static bool
+    splits_by_unit ()
+    {
+      return true;
     }
   };
 
+  std::shared_ptr <builtin>
+  op_unit_dwarf::reduce (std::string const &key, value const &val,
+			 bool pos_used)
+  {
+    uint64_t offset;
+    if (key == "offset" && pinned_constant (val, dw_offset_dom, offset))
+      return make_overload_op_builtin <op_unit_offset_dwarf> (offset);
+    return nullptr;
+  }
+
   std::unique_ptr <value>
-  cu_for_die (std::shared_ptr <dwfl_context> dwctx, Dwarf_Die die)
+  cu_for_die (dwctx_ptr dwctx, Dwarf_Die die)
   {
     Dwarf_Die cudie;
     if (dwarf_diecu (&die, &cudie, nullptr, nullptr) == nullptr)
@@ -279,6 +1204,7 @@ namespace
   struct op_unit_die
     : public op_overload <value_die>
   {
+    typedef value_cu result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -291,6 +1217,7 @@ namespace
   struct op_unit_attr
     : public op_overload <value_attr>
   {
+    typedef value_cu result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -307,6 +1234,7 @@ namespace
   struct op_child_die
     : public op_yielding_overload <value_die>
   {
+    typedef value_die result_type;
     using op_yielding_overload::op_yielding_overload;
 
     struct producer
@@ -331,7 +1259,8 @@ namespace
 	  {
 	  case 0:
 	    m_child = std::make_unique <value_die>
-	      (ret->get_dwctx (), child, ret->get_pos () + 1);
+	      (ret->get_dwctx (), child, ret->get_pos () + 1,
+	       ret->get_parent ());
 	  case 1: // no more siblings
 	    return std::move (ret);
 	  }
@@ -350,13 +1279,76 @@ namespace
 	  if (dwarf_child (die, &child) != 0)
 	    throw_libdw ();
 
-	  auto value = std::make_unique <value_die> (a->get_dwctx (), child, 0);
+	  auto value = std::make_unique <value_die>
+	    (a->get_dwctx (), child, 0, dwarf_dieoffset (die));
 	  return std::make_unique <producer> (std::move (value));
 	}
 
       return nullptr;
     }
+
+    static std::shared_ptr <builtin> reduce (std::string const &key,
+					     value const &val, bool pos_used);
+  };
+
+  // child (pos == KEY) or child (offset == KEY), depending on ByPos.
+  // Children are walked without creating values for them.
+  template <bool ByPos>
+  struct op_child_find_die
+    : public op_yielding_overload <value_die>
+  {
+    uint64_t m_key;
+
+    op_child_find_die (std::shared_ptr <op> upstream, uint64_t key)
+      : op_yielding_overload {upstream}
+      , m_key {key}
+    {}
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_die> a) override
+    {
+      Dwarf_Die *die = &a->get_die ();
+      if (! dwarf_haschildren (die))
+	return nullptr;
+
+      Dwarf_Die child;
+      if (dwarf_child (die, &child) != 0)
+	throw_libdw ();
+
+      for (size_t i = 0; ; ++i)
+	{
+	  uint64_t key = ByPos ? i : dwarf_dieoffset (&child);
+	  if (key == m_key)
+	    return std::make_unique <value_producer_single>
+	      (std::make_unique <value_die> (a->get_dwctx (), child, i,
+					     dwarf_dieoffset (die)));
+
+	  // Both positions and offsets of children grow.
+	  if (key > m_key)
+	    return nullptr;
+
+	  switch (dwarf_siblingof (&child, &child))
+	    {
+	    case -1:
+	      throw_libdw ();
+	    case 1:
+	      return nullptr;
+	    }
+	}
+    }
   };
+
+  std::shared_ptr <builtin>
+  op_child_die::reduce (std::string const &key, value const &val,
+			bool pos_used)
+  {
+    uint64_t k;
+    if (key == "pos" && pinned_constant (val, pos_dom, k))
+      return make_overload_op_builtin <op_child_find_die <true>> (k);
+    if (key == "offset" && pinned_constant (val, dw_offset_dom, k))
+      return make_overload_op_builtin <op_child_find_die <false>> (k);
+    return nullptr;
+  }
 }
 
 // elem, relem
@@ -498,27 +1490,31 @@ namespace
   struct op_attribute_die
     : public op_yielding_overload <value_die>
   {
+    typedef value_attr result_type;
     using op_yielding_overload::op_yielding_overload;
 
     struct producer
       : public value_producer
     {
       std::unique_ptr <value_die> m_value;
-      attr_iterator m_it;
+      die_attributes m_attrs;
       size_t m_i;
 
       producer (std::unique_ptr <value_die> value)
 	: m_value {std::move (value)}
-	, m_it {attr_iterator {&m_value->get_die ()}}
+	, m_attrs {&m_value->get_die ()}
 	, m_i {0}
       {}
 
       std::unique_ptr <value>
       next () override
       {
-	if (m_it != attr_iterator::end ())
-	  return std::make_unique <value_attr>
-	    (m_value->get_dwctx (), **m_it++, m_value->get_die (), m_i++);
+	if (m_i < m_attrs.size ())
+	  {
+	    size_t i = m_i++;
+	    return std::make_unique <value_attr>
+	      (m_value->get_dwctx (), m_attrs[i], m_value->get_die (), i);
+	  }
 	else
 	  return nullptr;
       }
@@ -529,11 +1525,76 @@ namespace
     {
       return std::make_unique <producer> (std::move (a));
     }
+
+    static std::shared_ptr <builtin> reduce (std::string const &key,
+					     value const &val, bool pos_used);
+  };
+
+  // attribute (label == NAME).  Attributes are still walked to keep
+  // their positions, but no values are created for those that don't
+  // match.
+  struct op_attribute_label_die
+    : public op_yielding_overload <value_die>
+  {
+    unsigned m_name;
+
+    op_attribute_label_die (std::shared_ptr <op> upstream, unsigned name)
+      : op_yielding_overload {upstream}
+      , m_name {name}
+    {}
+
+    struct producer
+      : public value_producer
+    {
+      std::unique_ptr <value_die> m_value;
+      die_attributes m_attrs;
+      unsigned m_name;
+      size_t m_i;
+
+      producer (std::unique_ptr <value_die> value, unsigned name)
+	: m_value {std::move (value)}
+	, m_attrs {&m_value->get_die ()}
+	, m_name {name}
+	, m_i {0}
+      {}
+
+      std::unique_ptr <value>
+      next () override
+      {
+	while (m_i < m_attrs.size ())
+	  {
+	    size_t i = m_i++;
+	    if (dwarf_whatattr (&m_attrs[i]) == m_name)
+	      return std::make_unique <value_attr>
+		(m_value->get_dwctx (), m_attrs[i], m_value->get_die (), i);
+	  }
+
+	return nullptr;
+      }
+    };
+
+    std::unique_ptr <value_producer>
+    operate (std::unique_ptr <value_die> a) override
+    {
+      return std::make_unique <producer> (std::move (a), m_name);
+    }
   };
 
+  std::shared_ptr <builtin>
+  op_attribute_die::reduce (std::string const &key, value const &val,
+			    bool pos_used)
+  {
+    uint64_t name;
+    if (key == "label" && pinned_constant (val, dw_attr_dom, name))
+      return make_overload_op_builtin <op_attribute_label_die>
+	((unsigned) name);
+    return nullptr;
+  }
+
   struct op_attribute_abbrev
     : public op_yielding_overload <value_abbrev>
   {
+    typedef value_abbrev_attr result_type;
     using op_yielding_overload::op_yielding_overload;
 
     struct producer
@@ -583,6 +1644,7 @@ namespace
   struct op_offset_cu
     : public op_overload <value_cu>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -596,6 +1658,7 @@ namespace
   struct op_offset_die
     : public op_overload <value_die>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -609,6 +1672,7 @@ namespace
   struct op_offset_abbrev_unit
     : public op_overload <value_abbrev_unit>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -628,6 +1692,7 @@ namespace
   struct op_offset_abbrev
     : public op_overload <value_abbrev>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -641,6 +1706,7 @@ namespace
   struct op_offset_abbrev_attr
     : public op_overload <value_abbrev_attr>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -654,6 +1720,7 @@ namespace
   struct op_offset_loclist_op
     : public op_overload <value_loclist_op>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -745,6 +1812,7 @@ namespace
   struct op_label_die
     : public op_overload <value_die>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -760,6 +1828,7 @@ namespace
   struct op_label_attr
     : public op_overload <value_attr>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -773,6 +1842,7 @@ namespace
   struct op_label_abbrev
     : public op_overload <value_abbrev>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -788,6 +1858,7 @@ namespace
   struct op_label_abbrev_attr
     : public op_overload <value_abbrev_attr>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -801,6 +1872,7 @@ namespace
   struct op_label_loclist_op
     : public op_overload <value_loclist_op>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -819,6 +1891,7 @@ namespace
   struct op_form_attr
     : public op_overload <value_attr>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -832,6 +1905,7 @@ namespace
   struct op_form_abbrev_attr
     : public op_overload <value_abbrev_attr>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -849,13 +1923,20 @@ namespace
   struct op_parent_die
     : public op_overload <value_die>
   {
+    typedef value_die result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
     operate (std::unique_ptr <value_die> a) override
     {
-      Dwarf_Off par_off = a->get_dwctx ()->find_parent (a->get_die ());
-      if (par_off == parent_cache::no_off)
+      Dwarf_Off par_off = a->get_parent ();
+      if (par_off == value_die::unknown_parent)
+	{
+	  par_off = a->get_dwctx ()->find_parent (a->get_die ());
+	  if (par_off == parent_cache::no_off)
+	    return nullptr;
+	}
+      else if (par_off == value_die::no_parent)
 	return nullptr;
 
       Dwarf_Die par_die;
@@ -921,6 +2002,8 @@ namespace
     pred_result
     result (value_die &a) override
     {
+      if (a.get_parent () != value_die::unknown_parent)
+	return pred_result (a.get_parent () == value_die::no_parent);
       return pred_result (a.get_dwctx ()->is_root (a.get_die ()));
     }
   };
@@ -945,6 +2028,7 @@ namespace
   struct op_root_cu
     : public op_overload <value_cu>
   {
+    typedef value_die result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -961,6 +2045,7 @@ namespace
   struct op_root_die
     : public op_overload <value_die>
   {
+    typedef value_die result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1024,6 +2109,7 @@ namespace
   struct op_low_aset
     : public op_overload <value_aset>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1059,6 +2145,7 @@ namespace
   struct op_high_aset
     : public op_overload <value_aset>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1101,6 +2188,7 @@ namespace
   struct op_aset_cst_cst
     : public op_overload <value_cst, value_cst>
   {
+    typedef value_aset result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1125,6 +2213,7 @@ namespace
   struct op_add_aset_cst
     : public op_overload <value_aset, value_cst>
   {
+    typedef value_aset result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1140,6 +2229,7 @@ namespace
   struct op_add_aset_aset
     : public op_overload <value_aset, value_aset>
   {
+    typedef value_aset result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1158,6 +2248,7 @@ namespace
   struct op_sub_aset_cst
     : public op_overload <value_aset, value_cst>
   {
+    typedef value_aset result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1173,6 +2264,7 @@ namespace
   struct op_sub_aset_aset
     : public op_overload <value_aset, value_aset>
   {
+    typedef value_aset result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1191,6 +2283,7 @@ namespace
   struct op_length_aset
     : public op_overload <value_aset>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1212,6 +2305,7 @@ namespace
   struct op_range_aset
     : public op_yielding_overload <value_aset>
   {
+    typedef value_aset result_type;
     using op_yielding_overload::op_yielding_overload;
 
     struct producer
@@ -1273,13 +2367,7 @@ namespace
     result (value_aset &a, value_aset &b) override
     {
       // ?contains holds if A contains all of B.
-      for (size_t i = 0; i < b.get_coverage ().size (); ++i)
-	{
-	  auto range = b.get_coverage ().at (i);
-	  if (! a.get_coverage ().is_covered (range.start, range.length))
-	    return pred_result::no;
-	}
-      return pred_result::yes;
+      return pred_result (a.get_coverage ().is_covered (b.get_coverage ()));
     }
   };
 }
@@ -1295,13 +2383,7 @@ namespace
     pred_result
     result (value_aset &a, value_aset &b) override
     {
-      for (size_t i = 0; i < b.get_coverage ().size (); ++i)
-	{
-	  auto range = b.get_coverage ().at (i);
-	  if (a.get_coverage ().is_overlap (range.start, range.length))
-	    return pred_result::yes;
-	}
-      return pred_result::no;
+      return pred_result (a.get_coverage ().is_overlap (b.get_coverage ()));
     }
   };
 }
@@ -1312,20 +2394,15 @@ namespace
   struct op_overlap_aset_aset
     : public op_overload <value_aset, value_aset>
   {
+    typedef value_aset result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
     operate (std::unique_ptr <value_aset> a,
 	     std::unique_ptr <value_aset> b) override
     {
-      coverage ret;
-      for (size_t i = 0; i < b->get_coverage ().size (); ++i)
-	{
-	  auto range = b->get_coverage ().at (i);
-	  auto cov = a->get_coverage ().intersect (range.start, range.length);
-	  ret.add_all (cov);
-	}
-      return std::make_unique <value_aset> (ret, 0);
+      return std::make_unique <value_aset>
+	(a->get_coverage ().intersect (b->get_coverage ()), 0);
     }
   };
 }
@@ -1352,15 +2429,16 @@ namespace
   struct op_abbrev_dwarf
     : public op_yielding_overload <value_dwarf>
   {
+    typedef value_abbrev_unit result_type;
     struct producer
       : public value_producer
     {
-      std::shared_ptr <dwfl_context> m_dwctx;
+      dwctx_ptr m_dwctx;
       dwfl_module_iterator m_modit;
       cu_iterator m_cuit;
       size_t m_i;
 
-      producer (std::shared_ptr <dwfl_context> dwctx)
+      producer (dwctx_ptr dwctx)
 	: m_dwctx {(assert (dwctx != nullptr), dwctx)}
 	, m_modit {m_dwctx->get_dwfl ()}
 	, m_cuit {cu_iterator::end ()}
@@ -1390,6 +2468,7 @@ namespace
   struct op_abbrev_cu
     : public op_overload <value_cu>
   {
+    typedef value_abbrev_unit result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1403,6 +2482,7 @@ namespace
   struct op_abbrev_die
     : public op_overload <value_die>
   {
+    typedef value_abbrev result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1454,6 +2534,7 @@ namespace
   struct op_code_abbrev
     : public op_overload <value_abbrev>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1472,6 +2553,7 @@ namespace
   struct op_version_cu
     : public op_overload <value_cu>
   {
+    typedef value_cst result_type;
     using op_overload::op_overload;
 
     std::unique_ptr <value>
@@ -1503,6 +2585,14 @@ namespace
       , m_atname {atname}
     {}
 
+    static std::unique_ptr <value>
+    as_projection (std::string &key, int atname)
+    {
+      key = "@AT";
+      return std::make_unique <value_cst>
+	(constant {(unsigned) atname, &dw_attr_dom}, 0);
+    }
+
     std::unique_ptr <value_producer>
     operate (std::unique_ptr <value_die> a)
     {
@@ -1527,11 +2617,19 @@ namespace
       : m_atname {atname}
     {}
 
+    // Attribute presence is a filter in its own right, with key "?AT".
+    static std::unique_ptr <value>
+    as_filter (std::string &key, unsigned atname)
+    {
+      key = "?AT";
+      return std::make_unique <value_cst>
+	(constant {atname, &dw_attr_dom}, 0);
+    }
+
     pred_result
     result (value_die &a) override
     {
-      Dwarf_Die *die = &a.get_die ();
-      return pred_result (dwarf_hasattr (die, m_atname) != 0);
+      return pred_result (a.get_dwctx ()->has_attr (a.get_die (), m_atname));
     }
   };
 
@@ -1623,6 +2721,14 @@ namespace
       : m_tag {tag}
     {}
 
+    static std::unique_ptr <value>
+    as_filter (std::string &key, int tag)
+    {
+      key = "label";
+      return std::make_unique <value_cst>
+	(constant {(unsigned) tag, &dw_tag_dom}, 0);
+    }
+
     pred_result
     result (value_die &a) override
     {
@@ -1804,6 +2910,8 @@ dwgrep_builtins_dw ()
     t->add_op_overload <op_entry_dwarf> ();
     t->add_op_overload <op_entry_cu> ();
     t->add_op_overload <op_entry_abbrev_unit> ();
+    t->add_op_overload <op_entry_dwarf_cst> ();
+    t->add_op_overload <op_entry_cu_cst> ();
 
     dict.add (std::make_shared <overloaded_op_builtin> ("entry", t));
   }
@@ -40,6 +40,12 @@ op_drop::next ()
   return nullptr;
 }
 
+void
+op_drop::update_shape (stack_shape &shape)
+{
+  shape.pop ();
+}
+
 stack::uptr
 op_swap::next ()
 {
@@ -54,6 +60,16 @@ op_swap::next ()
   return nullptr;
 }
 
+void
+op_swap::update_shape (stack_shape &shape)
+{
+  auto a = shape.get (0);
+  auto b = shape.get (1);
+  shape.pop (2);
+  shape.push (a);
+  shape.push (b);
+}
+
 stack::uptr
 op_dup::next ()
 {
@@ -65,6 +81,12 @@ op_dup::next ()
   return nullptr;
 }
 
+void
+op_dup::update_shape (stack_shape &shape)
+{
+  shape.push (shape.get (0));
+}
+
 stack::uptr
 op_over::next ()
 {
@@ -76,6 +98,12 @@ op_over::next ()
   return nullptr;
 }
 
+void
+op_over::update_shape (stack_shape &shape)
+{
+  shape.push (shape.get (1));
+}
+
 stack::uptr
 op_rot::next ()
 {
@@ -91,3 +119,15 @@ op_rot::next ()
     }
   return nullptr;
 }
+
+void
+op_rot::update_shape (stack_shape &shape)
+{
+  auto a = shape.get (0);
+  auto b = shape.get (1);
+  auto c = shape.get (2);
+  shape.pop (3);
+  shape.push (b);
+  shape.push (a);
+  shape.push (c);
+}
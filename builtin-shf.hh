@@ -36,6 +36,7 @@ struct op_drop
 {
   using inner_op::inner_op;
   stack::uptr next () override;
+  static void update_shape (stack_shape &shape);
 };
 
 struct op_swap
@@ -43,6 +44,7 @@ struct op_swap
 {
   using inner_op::inner_op;
   stack::uptr next () override;
+  static void update_shape (stack_shape &shape);
 };
 
 struct op_dup
@@ -50,6 +52,7 @@ struct op_dup
 {
   using inner_op::inner_op;
   stack::uptr next () override;
+  static void update_shape (stack_shape &shape);
 };
 
 struct op_over
@@ -57,6 +60,7 @@ struct op_over
 {
   using inner_op::inner_op;
   stack::uptr next () override;
+  static void update_shape (stack_shape &shape);
 };
 
 struct op_rot
@@ -64,6 +68,7 @@ struct op_rot
 {
   using inner_op::inner_op;
   stack::uptr next () override;
+  static void update_shape (stack_shape &shape);
 };
 
 #endif /* _BUILTIN_SHF_H_ */
@@ -48,6 +48,37 @@ builtin::build_exec (std::shared_ptr <op> upstream) const
   return nullptr;
 }
 
+void
+builtin::update_shape (stack_shape &shape) const
+{
+  shape.clear ();
+}
+
+std::shared_ptr <builtin>
+builtin::reduce (std::string const &key, value const &val,
+		 bool pos_used) const
+{
+  return nullptr;
+}
+
+std::unique_ptr <value>
+builtin::as_filter (std::string &key) const
+{
+  return nullptr;
+}
+
+std::unique_ptr <value>
+builtin::as_projection (std::string &key) const
+{
+  return nullptr;
+}
+
+bool
+builtin::splits_by_unit () const
+{
+  return false;
+}
+
 std::unique_ptr <pred>
 pred_builtin::maybe_invert (std::unique_ptr <pred> pred) const
 {
@@ -34,6 +34,7 @@
 
 #include "dwgrep.hh"
 #include "constant.hh"
+#include "shape.hh"
 #include "value.hh"
 
 struct pred;
@@ -49,6 +50,36 @@ public:
   build_exec (std::shared_ptr <op> upstream) const;
 
   virtual char const *name () const = 0;
+
+  // Update SHAPE to describe the stack after this builtin runs.  The
+  // default makes no assumptions and forgets everything.
+  virtual void update_shape (stack_shape &shape) const;
+
+  // Reduction point.  Return a builtin that computes the same as this
+  // one followed by an assertion (KEY == VAL), only more directly, or
+  // nullptr if there's no such shortcut.  POS_USED tells whether the
+  // program ever looks at positions of values.  Filters of the form
+  // ?(KEY VAL PRED) come with KEY set to "KEY PRED".  Keys that start
+  // with '@' stand for projections (see as_projection), and the
+  // builtin then computes this one followed by the projection.
+  virtual std::shared_ptr <builtin>
+  reduce (std::string const &key, value const &val, bool pos_used) const;
+
+  // If this is a predicate that holds exactly when the assertion
+  // (KEY == VAL) would, set KEY and return VAL.  Otherwise return
+  // nullptr.  Such predicates can then be reduced the same way.
+  virtual std::unique_ptr <value> as_filter (std::string &key) const;
+
+  // If this is an op that replaces TOS by values that projection KEY
+  // of VAL computes from it, set KEY and return VAL.  Otherwise
+  // return nullptr.
+  virtual std::unique_ptr <value> as_projection (std::string &key) const;
+
+  // Whether this builtin, applied to a Dwarf, only visits units in
+  // the range that the Dwarf was restricted to, one unit after
+  // another.  Queries that start with such a builtin can be split
+  // across units.
+  virtual bool splits_by_unit () const;
 };
 
 class pred_builtin
@@ -62,6 +93,17 @@ public:
     : m_positive {positive}
   {}
 
+  // Predicates don't change the stack.
+  void
+  update_shape (stack_shape &shape) const override
+  {}
+
+  bool
+  positive () const
+  {
+    return m_positive;
+  }
+
   // Return either PRED, or PRED_NOT(PRED), depending on M_POSITIVE.
   std::unique_ptr <pred> maybe_invert (std::unique_ptr <pred> pred) const;
 };
@@ -131,6 +173,12 @@ add_simple_exec_builtin (builtin_dict &dict, char const *name)
     {
       return m_name;
     }
+
+    void
+    update_shape (stack_shape &shape) const override final
+    {
+      Op::update_shape (shape);
+    }
   };
 
   dict.add (std::make_shared <simple_exec_builtin> (name));
@@ -29,20 +29,33 @@
 #include <cassert>
 #include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <dwarf.h>
 
 #include "cache.hh"
 #include "dwpp.hh"
 #include "dwgrep.hh"
 #include "dwit.hh"
 
+namespace
+{
+  uint32_t
+  unit_relative (Dwarf_Off off, Dwarf_Off cuoff)
+  {
+    if (off - cuoff >= UINT32_MAX)
+      throw std::runtime_error ("unit too large to cache DIE parents");
+    return off - cuoff;
+  }
+}
+
 void
 parent_cache::recursively_populate_unit (unit_cache_t &uc, Dwarf_Die die,
-					 Dwarf_Off paroff)
+					 uint32_t paroff)
 {
   while (true)
     {
-      Dwarf_Off off = dwarf_dieoffset (&die);
-      uc.push_back (std::make_pair (off, paroff));
+      uint32_t off = unit_relative (dwarf_dieoffset (&die), uc.cuoff);
+      uc.entries.push_back (entry {off, paroff});
 
       if (dwarf_haschildren (&die))
 	{
@@ -68,34 +81,37 @@ parent_cache::unit_cache_t
 parent_cache::populate_unit (Dwarf_Die die)
 {
   unit_cache_t uc;
-  recursively_populate_unit (uc, die, no_off);
+  uc.cuoff = dwarf_dieoffset (&die);
+  recursively_populate_unit (uc, die, no_rel_off);
   return uc;
 }
 
 Dwarf_Off
 parent_cache::find (Dwarf_Die die)
 {
-  Dwarf_Die cudie;
-  if (dwarf_diecu (&die, &cudie, nullptr, nullptr) == nullptr)
-    throw_libdw ();
-
-  Dwarf_Off cuoff = dwarf_dieoffset (&cudie);
-  auto key = unit_key {unit_type::INFO, cuoff};
-  auto it = m_cache.find (key);
+  auto it = m_cache.find (die.cu);
   if (it == m_cache.end ())
-    it = m_cache.insert (std::make_pair (key, populate_unit (cudie))).first;
+    {
+      Dwarf_Die cudie;
+      if (dwarf_diecu (&die, &cudie, nullptr, nullptr) == nullptr)
+	throw_libdw ();
+
+      it = m_cache.insert (std::make_pair (die.cu, populate_unit (cudie)))
+	.first;
+    }
 
-  Dwarf_Off dieoff = dwarf_dieoffset (&die);
+  unit_cache_t const &uc = it->second;
+  uint32_t off = unit_relative (dwarf_dieoffset (&die), uc.cuoff);
   auto jt = std::lower_bound
-    (it->second.begin (), it->second.end (), dieoff,
-     [] (std::pair <Dwarf_Off, Dwarf_Off> const &a, Dwarf_Off b)
+    (uc.entries.begin (), uc.entries.end (), off,
+     [] (entry const &a, uint32_t b)
      {
-       return a.first < b;
+       return a.off < b;
      });
 
-  assert (jt != it->second.end ());
-  assert (jt->first == dieoff);
-  return jt->second;
+  assert (jt != uc.entries.end ());
+  assert (jt->off == off);
+  return jt->paroff == no_rel_off ? no_off : uc.cuoff + jt->paroff;
 }
 
 
@@ -114,3 +130,208 @@ root_cache::is_root (Dwarf_Die die, Dwarf *dw)
   return m_roots->find (std::make_pair (unit_type::INFO, off))
     != m_roots->end ();
 }
+
+namespace
+{
+  struct die_range
+  {
+    Dwarf_Addr low;
+    Dwarf_Addr high;
+    Dwarf_Off off;
+    int tag;
+  };
+
+  bool
+  has_range_attr (Dwarf_Die &die)
+  {
+    // Like dwarf_ranges, only look through to other DIEs for unit DIEs,
+    // which may inherit the attributes from a skeleton unit.
+    if (dwarf_tag (&die) == DW_TAG_compile_unit)
+      return dwarf_hasattr_integrate (&die, DW_AT_low_pc)
+	|| dwarf_hasattr_integrate (&die, DW_AT_ranges);
+
+    return dwarf_hasattr (&die, DW_AT_low_pc)
+      || dwarf_hasattr (&die, DW_AT_ranges);
+  }
+
+  void
+  collect_die_ranges (std::vector <die_range> &ret, Dwarf_Die die)
+  {
+    while (true)
+      {
+	// DIEs that have neither attribute have no address ranges.
+	if (has_range_attr (die))
+	  {
+	    Dwarf_Off off = dwarf_dieoffset (&die);
+	    int tag = dwarf_tag (&die);
+	    Dwarf_Addr base, start, end;
+	    for (ptrdiff_t it = 0;
+		 (it = dwarf_ranges (&die, it, &base, &start, &end)) != 0; )
+	      if (it < 0)
+		throw_libdw ();
+	      else if (start < end)
+		ret.push_back (die_range {start, end, off, tag});
+	  }
+
+	if (dwarf_haschildren (&die))
+	  {
+	    Dwarf_Die child;
+	    if (dwarf_child (&die, &child) != 0)
+	      throw_libdw ();
+	    collect_die_ranges (ret, child);
+	  }
+
+	switch (dwarf_siblingof (&die, &die))
+	  {
+	  case 0:
+	    break;
+	  case -1:
+	    throw_libdw ();
+	  case 1:
+	    return;
+	  }
+      }
+  }
+}
+
+address_cache::unit_index
+address_cache::populate_unit (Dwarf_Die cudie)
+{
+  std::vector <die_range> by_low;
+  collect_die_ranges (by_low, cudie);
+
+  std::vector <die_range> by_high = by_low;
+  std::sort (by_low.begin (), by_low.end (),
+	     [] (die_range const &a, die_range const &b)
+	     { return a.low < b.low; });
+  std::sort (by_high.begin (), by_high.end (),
+	     [] (die_range const &a, die_range const &b)
+	     { return a.high < b.high; });
+
+  unit_index ret;
+  for (auto const &r: by_low)
+    {
+      ret.m_bounds.push_back (r.low);
+      ret.m_bounds.push_back (r.high);
+    }
+  std::sort (ret.m_bounds.begin (), ret.m_bounds.end ());
+  ret.m_bounds.erase (std::unique (ret.m_bounds.begin (), ret.m_bounds.end ()),
+		      ret.m_bounds.end ());
+
+  // Sweep the boundaries, keeping track of DIEs whose ranges are open.
+  // A DIE may have several ranges that cover the same address, hence
+  // the count.
+  std::map <Dwarf_Off, std::pair <int, size_t>> open;
+  auto lt = by_low.begin ();
+  auto ht = by_high.begin ();
+  for (Dwarf_Addr b: ret.m_bounds)
+    {
+      for (; ht != by_high.end () && ht->high == b; ++ht)
+	{
+	  auto it = open.find (ht->off);
+	  assert (it != open.end ());
+	  if (--it->second.second == 0)
+	    open.erase (it);
+	}
+
+      for (; lt != by_low.end () && lt->low == b; ++lt)
+	{
+	  auto &o = open[lt->off];
+	  o.first = lt->tag;
+	  ++o.second;
+	}
+
+      ret.m_firsts.push_back (ret.m_dies.size ());
+      for (auto const &o: open)
+	ret.m_dies.push_back (die_ref {o.first, o.second.first});
+    }
+
+  assert (open.empty ());
+  ret.m_firsts.push_back (ret.m_dies.size ());
+  return ret;
+}
+
+std::vector <Dwarf_Off>
+address_cache::find (Dwarf_Die cudie, Dwarf_Addr addr, int tag)
+{
+  auto key = unit_key {dwarf_cu_getdwarf (cudie.cu), dwarf_dieoffset (&cudie)};
+  auto it = m_cache.find (key);
+  if (it == m_cache.end ())
+    it = m_cache.insert (std::make_pair (key, populate_unit (cudie))).first;
+
+  unit_index const &ui = it->second;
+  auto bt = std::upper_bound (ui.m_bounds.begin (), ui.m_bounds.end (), addr);
+  if (bt == ui.m_bounds.begin ())
+    return {};
+
+  size_t i = bt - ui.m_bounds.begin () - 1;
+  std::vector <Dwarf_Off> ret;
+  for (size_t j = ui.m_firsts[i]; j < ui.m_firsts[i + 1]; ++j)
+    if (tag == -1 || ui.m_dies[j].tag == tag)
+      ret.push_back (ui.m_dies[j].off);
+  return ret;
+}
+
+namespace
+{
+  // Abbreviation of DIE, or nullptr if it can't be had.  libdw has no
+  // call for this, but dwarf_tag looks the abbreviation up and leaves
+  // it in DIE's abbrev field.  That field is declared in libdw.h, but
+  // its meaning is libdw's business, which is why it is only
+  // consulted here.  Should the abbreviation that it points to not
+  // agree with the tag, callers use dwarf_hasattr instead.
+  Dwarf_Abbrev *
+  die_abbrev (Dwarf_Die &die)
+  {
+    // dwarf_tag answers 0 when there's no abbreviation.
+    int tag = dwarf_tag (&die);
+    if (tag <= 0)
+      return nullptr;
+
+    Dwarf_Abbrev *abbrev = die.abbrev;
+    if (abbrev == nullptr || dwarf_getabbrevtag (abbrev) != (unsigned) tag)
+      return nullptr;
+
+    return abbrev;
+  }
+}
+
+abbrev_attr_cache::attr_names_t const &
+abbrev_attr_cache::find_abbrev (Dwarf_Abbrev *abbrev)
+{
+  if (abbrev == m_last_abbrev)
+    return *m_last;
+
+  auto it = m_cache.find (abbrev);
+  if (it == m_cache.end ())
+    {
+      attr_names_t names;
+
+      // The attribute count that libdw reports can be off when
+      // DW_FORM_implicit_const is involved, so read until the end.
+      unsigned int name;
+      for (size_t i = 0; dwarf_getabbrevattr (abbrev, i, &name,
+					       nullptr, nullptr) == 0; ++i)
+	if (name < max_name)
+	  names.set (name);
+
+      it = m_cache.insert (std::make_pair (abbrev, names)).first;
+    }
+
+  m_last_abbrev = abbrev;
+  m_last = &it->second;
+  return *m_last;
+}
+
+bool
+abbrev_attr_cache::has_attr (Dwarf_Die &die, unsigned name)
+{
+  if (name >= max_name)
+    return dwarf_hasattr (&die, name) != 0;
+
+  Dwarf_Abbrev *abbrev = die_abbrev (die);
+  if (abbrev == nullptr)
+    return dwarf_hasattr (&die, name) != 0;
+
+  return find_abbrev (abbrev).test (name);
+}
@@ -29,7 +29,10 @@
 #ifndef _CACHE_H_
 #define _CACHE_H_
 
+#include <bitset>
+#include <cstdint>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 #include <memory>
 #include <vector>
@@ -41,28 +44,33 @@ enum class unit_type
     INFO,
   };
 
+// Parents of DIEs, looked up by offset.  Each unit is walked on
+// first use.  Offsets are recorded relative to the unit DIE, which
+// keeps entries at 32 bits, and units are found by their Dwarf_CU
+// handle, so that the unit DIE needn't be looked up for every query.
 class parent_cache
 {
-  struct unit_key
+  struct entry
   {
-    unit_type ut;
-    Dwarf_Off off;	// CU offset.
+    uint32_t off;	// Relative to the unit DIE.
+    uint32_t paroff;	// Likewise, or no_rel_off for the unit DIE.
+  };
 
-    bool
-    operator< (unit_key other) const
-    {
-      return ut < other.ut || (ut == other.ut && off < other.off);
-    }
+  static uint32_t const no_rel_off = UINT32_MAX;
+
+  struct unit_cache_t
+  {
+    Dwarf_Off cuoff;
+    std::vector <entry> entries;	// In order of OFF.
   };
 
-  typedef std::vector <std::pair <Dwarf_Off, Dwarf_Off> > unit_cache_t;
-  typedef std::map <unit_key, unit_cache_t> cache_t;
+  typedef std::unordered_map <Dwarf_CU *, unit_cache_t> cache_t;
 
   cache_t m_cache;
 
-  void recursively_populate_unit (unit_cache_t &uc, Dwarf_Die die,
-				  Dwarf_Off paroff);
-  unit_cache_t populate_unit (Dwarf_Die die);
+  static void recursively_populate_unit (unit_cache_t &uc, Dwarf_Die die,
+					 uint32_t paroff);
+  static unit_cache_t populate_unit (Dwarf_Die die);
 
 public:
   static Dwarf_Off const no_off = (Dwarf_Off) -1;
@@ -90,5 +98,69 @@ public:
   bool is_root (Dwarf_Die die, Dwarf *dw);
 };
 
+// Maps addresses to DIEs whose address ranges cover them.  Each unit
+// is indexed on first use: the boundaries of all DIE ranges split the
+// address space into segments, and for each segment, the DIEs that
+// cover it are listed in offset order.
+class address_cache
+{
+  struct die_ref
+  {
+    Dwarf_Off off;
+    int tag;
+  };
+
+  struct unit_index
+  {
+    // Segment I spans [m_bounds[I], m_bounds[I + 1]) and is covered by
+    // DIEs m_dies[m_firsts[I]] up to m_dies[m_firsts[I + 1]].
+    std::vector <Dwarf_Addr> m_bounds;
+    std::vector <size_t> m_firsts;
+    std::vector <die_ref> m_dies;
+  };
+
+  typedef std::pair <Dwarf *, Dwarf_Off> unit_key;
+  std::map <unit_key, unit_index> m_cache;
+
+  static unit_index populate_unit (Dwarf_Die cudie);
+
+public:
+  // Offsets of DIEs of the unit CUDIE whose ranges contain ADDR, in
+  // ascending order.  Unless TAG is -1, only DIEs with that tag are
+  // considered.
+  std::vector <Dwarf_Off> find (Dwarf_Die cudie, Dwarf_Addr addr, int tag);
+};
+
+// Attributes that DIEs have, as given by their abbreviations.  The
+// attribute names of an abbreviation are collected into a bit set
+// when a DIE with that abbreviation is first seen, so that further
+// queries are a bit test.
+class abbrev_attr_cache
+{
+  // Attribute names below this are kept in the sets, which covers
+  // DWARF 5.  Vendor attributes are looked up in the DIE.
+  static unsigned const max_name = 0x100;
+
+  typedef std::bitset <max_name> attr_names_t;
+
+  // Abbreviations stay put for as long as their Dwarf is open, so
+  // they can be used as keys.
+  std::unordered_map <Dwarf_Abbrev *, attr_names_t> m_cache;
+
+  // DIEs with the same abbreviation tend to come in runs.
+  Dwarf_Abbrev *m_last_abbrev;
+  attr_names_t const *m_last;
+
+  attr_names_t const &find_abbrev (Dwarf_Abbrev *abbrev);
+
+public:
+  abbrev_attr_cache ()
+    : m_last_abbrev {nullptr}
+    , m_last {nullptr}
+  {}
+
+  // Whether DIE has an attribute NAME, as dwarf_hasattr would tell.
+  bool has_attr (Dwarf_Die &die, unsigned name);
+};
 
 #endif /* _CACHE_H_ */
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <elfutils/libdw.h>
+#include <algorithm>
 
 #include "flag_saver.hh"
 
@@ -298,7 +299,7 @@ coverage::intersect (uint64_t start, uint64_t length) const
     {
       auto j = r_i - 1;
       if (start < j->start + j->length)
-	ret.add (start, j->start + j->length - start);
+	ret.add (start, std::min (j->start + j->length, a_end) - start);
     }
 
   // Handle intersection with following ranges.
@@ -354,20 +355,166 @@ coverage::find_ranges (bool (*cb)(uint64_t start, uint64_t length, void *data),
   return true;
 }
 
+namespace
+{
+  // Append R to RANGES, which are sorted by start.  R mustn't start
+  // before the last range does.  It's coalesced with that range if
+  // they overlap or touch.
+  void
+  append (std::vector<cov_range> &ranges, cov_range const &r)
+  {
+    if (r.length == 0)
+      return;
+
+    if (! ranges.empty () && r.start <= ranges.back ().end ())
+      {
+	if (r.end () > ranges.back ().end ())
+	  ranges.back ().length = r.end () - ranges.back ().start;
+      }
+    else
+      ranges.push_back (r);
+  }
+
+  // First range of sorted [IT, END) that ends after ADDR.
+  std::vector<cov_range>::const_iterator
+  skip_to (std::vector<cov_range>::const_iterator it,
+	   std::vector<cov_range>::const_iterator end, uint64_t addr)
+  {
+    return std::partition_point (it, end, [addr] (cov_range const &r)
+				 { return r.end () <= addr; });
+  }
+
+  // Call F on each pair of overlapping ranges from A and B, in
+  // ascending order, until it returns false.  The smaller of the two
+  // is walked, ranges of the other one are skipped by binary search.
+  template <class F>
+  void
+  for_each_overlap (std::vector<cov_range> const &a,
+		    std::vector<cov_range> const &b, F f)
+  {
+    bool swapped = a.size () > b.size ();
+    auto const &outer = swapped ? b : a;
+    auto const &inner = swapped ? a : b;
+
+    auto jt = inner.begin ();
+    for (auto const &r: outer)
+      {
+	jt = skip_to (jt, inner.end (), r.start);
+	for (auto kt = jt; kt != inner.end () && kt->start < r.end (); ++kt)
+	  if (! (swapped ? f (*kt, r) : f (r, *kt)))
+	    return;
+      }
+  }
+}
+
 void
 coverage::add_all (coverage const &other)
 {
-  for (size_t i = 0; i < other.size (); ++i)
-    add (other[i].start, other[i].length);
+  if (other.empty ())
+    return;
+  if (other.size () == 1)
+    {
+      add (other[0].start, other[0].length);
+      return;
+    }
+
+  std::vector<cov_range> ret;
+  ret.reserve (size () + other.size ());
+  const_iterator it = begin ();
+  const_iterator jt = other.begin ();
+  while (it != end () || jt != other.end ())
+    if (jt == other.end () || (it != end () && it->start < jt->start))
+      append (ret, *it++);
+    else
+      append (ret, *jt++);
+
+  std::vector<cov_range>::swap (ret);
+}
+
+void
+coverage::add_all (std::vector<cov_range> ranges)
+{
+  std::sort (ranges.begin (), ranges.end (),
+	     [] (cov_range const &a, cov_range const &b)
+	     { return a.start < b.start; });
+
+  coverage sorted;
+  for (auto const &r: ranges)
+    append (sorted, r);
+
+  if (empty ())
+    std::vector<cov_range>::swap (sorted);
+  else
+    add_all (sorted);
 }
 
 bool
 coverage::remove_all (coverage const &other)
+{
+  if (empty () || other.empty ())
+    return false;
+
+  std::vector<cov_range> ret;
+  bool removed = false;
+  const_iterator jt = other.begin ();
+  for (auto const &r: *this)
+    {
+      uint64_t start = r.start;
+      jt = skip_to (jt, other.end (), start);
+      for (auto kt = jt; kt != other.end () && kt->start < r.end (); ++kt)
+	{
+	  removed = true;
+	  if (kt->start > start)
+	    ret.push_back (cov_range {start, kt->start - start});
+	  start = std::max (start, kt->end ());
+	}
+
+      if (start < r.end ())
+	ret.push_back (cov_range {start, r.end () - start});
+    }
+
+  std::vector<cov_range>::swap (ret);
+  return removed;
+}
+
+coverage
+coverage::intersect (coverage const &other) const
+{
+  coverage ret;
+  for_each_overlap (*this, other,
+		    [&ret] (cov_range const &a, cov_range const &b)
+		    {
+		      uint64_t start = std::max (a.start, b.start);
+		      uint64_t end = std::min (a.end (), b.end ());
+		      ret.push_back (cov_range {start, end - start});
+		      return true;
+		    });
+  return ret;
+}
+
+bool
+coverage::is_covered (coverage const &other) const
+{
+  const_iterator it = begin ();
+  for (auto const &r: other)
+    {
+      it = skip_to (it, end (), r.start);
+      if (it == end () || it->start > r.start || it->end () < r.end ())
+	return false;
+    }
+  return true;
+}
+
+bool
+coverage::is_overlap (coverage const &other) const
 {
   bool ret = false;
-  for (size_t i = 0; i < other.size (); ++i)
-    if (remove (other[i].start, other[i].length))
-      ret = true;
+  for_each_overlap (*this, other,
+		    [&ret] (cov_range const &a, cov_range const &b)
+		    {
+		      ret = true;
+		      return false;
+		    });
   return ret;
 }
 
@@ -67,12 +67,20 @@ public:
   /// range falls into hole in coverage.
   bool remove (uint64_t start, uint64_t length);
 
+  // The following work by merging the two sorted sequences of
+  // ranges, which takes time linear in their sizes.  They are much
+  // cheaper than adding or removing the ranges one by one.
   void add_all (coverage const &other);
 
   // Returns true if something was actually removed, false if whole
   // range falls into hole in coverage.
   bool remove_all (coverage const &other);
 
+  /// Add all RANGES at once.  They need not be sorted, and may
+  /// overlap.  They are sorted and coalesced in one go, which avoids
+  /// the quadratic cost of calling add for each of them.
+  void add_all (std::vector <cov_range> ranges);
+
   bool find_ranges (bool (*cb)(uint64_t start, uint64_t length, void *data),
 		    void *data) const;
 
@@ -94,6 +102,16 @@ public:
   /// START/LENGTH don't overlap with this coverage at all.
   coverage intersect (uint64_t start, uint64_t length) const;
 
+  /// Intersection of this coverage with OTHER.
+  coverage intersect (coverage const &other) const;
+
+  /// Returns true if every range of OTHER is covered by this
+  /// coverage.
+  bool is_covered (coverage const &other) const;
+
+  /// Returns true if at least some of OTHER overlaps this coverage.
+  bool is_overlap (coverage const &other) const;
+
   bool find_holes (uint64_t start, uint64_t length,
 		   bool (*cb)(uint64_t start, uint64_t length, void *data),
 		   void *data) const;
@@ -26,30 +26,119 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <map>
+#include <system_error>
+#include <vector>
+
 #include "dwfl_context.hh"
+#include "dwindex.hh"
+#include "dwpp.hh"
 #include "cache.hh"
 
+namespace
+{
+  struct module_info
+  {
+    Dwarf *dw;
+    std::string build_id;
+  };
+
+  int
+  module_cb (Dwfl_Module *mod, void **data, const char *name,
+	     Dwarf_Addr addr, void *arg)
+  {
+    auto modules = static_cast <std::vector <module_info> *> (arg);
+
+    Dwarf_Addr bias;
+    Dwarf *dw = dwfl_module_getdwarf (mod, &bias);
+
+    unsigned char const *bits;
+    GElf_Addr vaddr;
+    int len = dwfl_module_build_id (mod, &bits, &vaddr);
+
+    if (dw != nullptr && len > 0)
+      modules->push_back (module_info
+			  {dw, std::string ((char const *) bits, len)});
+    return DWARF_CB_OK;
+  }
+
+  // Modules of DWFL that have DWARF and a build ID.
+  std::vector <module_info>
+  indexable_modules (Dwfl *dwfl)
+  {
+    std::vector <module_info> ret;
+    if (dwfl_getmodules (dwfl, module_cb, &ret, 0) == -1)
+      throw_libdwfl ();
+    return ret;
+  }
+}
+
 struct dwfl_context::pimpl
 {
+  std::string m_fn;
   parent_cache m_parcache;
   root_cache m_rootcache;
+  address_cache m_addrcache;
+  abbrev_attr_cache m_attrcache;
+
+  // Indices are looked up on first use.  A missing index is recorded
+  // as a nullptr, so that it's not looked up again.
+  std::map <Dwarf *, std::unique_ptr <die_index>> m_indices;
+
+  explicit pimpl (std::string const &fn)
+    : m_fn {fn}
+  {}
+
+  die_index const *
+  find_index (Dwfl *dwfl, Dwarf *dw)
+  {
+    if (die_index::directory ().empty ())
+      return nullptr;
+
+    auto it = m_indices.find (dw);
+    if (it != m_indices.end ())
+      return it->second.get ();
+
+    std::unique_ptr <die_index> idx;
+    struct stat st;
+    if (stat (m_fn.c_str (), &st) == 0)
+      for (auto const &mod: indexable_modules (dwfl))
+	if (mod.dw == dw)
+	  idx = die_index::open (mod.build_id, st);
+
+    return m_indices.insert (std::make_pair (dw, std::move (idx)))
+      .first->second.get ();
+  }
 
   Dwarf_Off
-  find_parent (Dwarf_Die die)
+  find_parent (Dwfl *dwfl, Dwarf_Die die)
   {
+    if (auto idx = find_index (dwfl, dwarf_cu_getdwarf (die.cu)))
+      if (auto rec = idx->find_die (dwarf_dieoffset (&die)))
+	return rec->parent;
+
     return m_parcache.find (die);
   }
 
   bool
-  is_root (Dwarf_Die die, Dwarf *dw)
+  is_root (Dwfl *dwfl, Dwarf_Die die, Dwarf *dw)
   {
+    if (auto idx = find_index (dwfl, dw))
+      if (auto rec = idx->find_die (dwarf_dieoffset (&die)))
+	return rec->parent == die_index::no_off;
+
     return m_rootcache.is_root (die, dw);
   }
 };
 
-dwfl_context::dwfl_context (std::shared_ptr <Dwfl> dwfl)
-  : m_pimpl {std::make_unique <pimpl> ()}
+dwfl_context::dwfl_context (std::shared_ptr <Dwfl> dwfl,
+			    std::string const &fn)
+  : m_pimpl {std::make_unique <pimpl> (fn)}
   , m_dwfl {dwfl}
+  , m_refs {0}
 {}
 
 dwfl_context::~dwfl_context ()
@@ -58,11 +147,43 @@ dwfl_context::~dwfl_context ()
 Dwarf_Off
 dwfl_context::find_parent (Dwarf_Die die)
 {
-  return m_pimpl->find_parent (die);
+  return m_pimpl->find_parent (get_dwfl (), die);
 }
 
 bool
 dwfl_context::is_root (Dwarf_Die die)
 {
-  return m_pimpl->is_root (die, dwarf_cu_getdwarf (die.cu));
+  return m_pimpl->is_root (get_dwfl (), die, dwarf_cu_getdwarf (die.cu));
+}
+
+std::vector <Dwarf_Off>
+dwfl_context::find_dies_at (Dwarf_Die cudie, Dwarf_Addr addr, int tag)
+{
+  return m_pimpl->m_addrcache.find (cudie, addr, tag);
+}
+
+bool
+dwfl_context::has_attr (Dwarf_Die &die, unsigned name)
+{
+  return m_pimpl->m_attrcache.has_attr (die, name);
+}
+
+die_index const *
+dwfl_context::find_index (Dwarf *dw)
+{
+  return m_pimpl->find_index (get_dwfl (), dw);
+}
+
+size_t
+dwfl_context::write_indices ()
+{
+  struct stat st;
+  if (stat (m_pimpl->m_fn.c_str (), &st) != 0)
+    throw std::runtime_error
+      (std::error_code (errno, std::system_category ()).message ());
+
+  auto modules = indexable_modules (get_dwfl ());
+  for (auto const &mod: modules)
+    die_index::write (mod.dw, mod.build_id, st);
+  return modules.size ();
 }
@@ -30,17 +30,27 @@
 #define _DWFL_CONTEXT_H_
 
 #include <memory>
+#include <string>
+#include <vector>
 #include <elfutils/libdwfl.h>
 
+class die_index;
+
 // This represents a Dwfl handle together with some query caches.
 class dwfl_context
 {
+  friend class dwctx_ptr;
+
   class pimpl;
   std::unique_ptr <pimpl> m_pimpl;
   std::shared_ptr <Dwfl> m_dwfl;
 
+  // Number of dwctx_ptr's referring to this context.
+  unsigned m_refs;
+
 public:
-  explicit dwfl_context (std::shared_ptr <Dwfl> dwfl);
+  // FN is the name of the file that DWFL was opened from.
+  dwfl_context (std::shared_ptr <Dwfl> dwfl, std::string const &fn);
   ~dwfl_context ();
 
   Dwfl *get_dwfl ()
@@ -48,6 +58,91 @@ public:
 
   Dwarf_Off find_parent (Dwarf_Die die);
   bool is_root (Dwarf_Die die);
+
+  // Offsets of DIEs of the unit CUDIE whose address ranges contain
+  // ADDR, in ascending order.  Unless TAG is -1, only DIEs with that
+  // tag are reported.
+  std::vector <Dwarf_Off> find_dies_at (Dwarf_Die cudie, Dwarf_Addr addr,
+					int tag);
+
+  // Whether DIE has an attribute NAME.  Answered from the abbreviation
+  // of DIE, which is decoded once per unit.
+  bool has_attr (Dwarf_Die &die, unsigned name);
+
+  // DIE index of DW, or nullptr if there's no usable one.
+  die_index const *find_index (Dwarf *dw);
+
+  // Write DIE indices of all modules that have a build ID.  Returns
+  // the number of indices written.
+  size_t write_indices ();
+};
+
+// Owning pointer to a dwfl_context.  Every value that refers to DWARF
+// data carries one, so this uses a plain intrusive count instead of
+// the atomic one that shared_ptr would have.  That's fine, as a context
+// is only ever used from the thread that opened it.
+class dwctx_ptr
+{
+  dwfl_context *m_ctx;
+
+public:
+  dwctx_ptr ()
+    : m_ctx {nullptr}
+  {}
+
+  explicit dwctx_ptr (dwfl_context *ctx)
+    : m_ctx {ctx}
+  {
+    if (m_ctx != nullptr)
+      ++m_ctx->m_refs;
+  }
+
+  dwctx_ptr (dwctx_ptr const &that)
+    : dwctx_ptr {that.m_ctx}
+  {}
+
+  dwctx_ptr (dwctx_ptr &&that) noexcept
+    : m_ctx {that.m_ctx}
+  {
+    that.m_ctx = nullptr;
+  }
+
+  ~dwctx_ptr ()
+  {
+    if (m_ctx != nullptr && --m_ctx->m_refs == 0)
+      delete m_ctx;
+  }
+
+  dwctx_ptr &
+  operator= (dwctx_ptr that)
+  {
+    std::swap (m_ctx, that.m_ctx);
+    return *this;
+  }
+
+  dwfl_context *
+  operator-> () const
+  {
+    return m_ctx;
+  }
+
+  dwfl_context &
+  operator* () const
+  {
+    return *m_ctx;
+  }
+
+  bool
+  operator== (std::nullptr_t) const
+  {
+    return m_ctx == nullptr;
+  }
+
+  bool
+  operator!= (std::nullptr_t) const
+  {
+    return m_ctx != nullptr;
+  }
 };
 
 #endif /* _DWFL_CONTEXT_H_ */
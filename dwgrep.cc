@@ -27,18 +27,30 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <getopt.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <libintl.h>
 
 #include "builtin-dw.hh"
+#include "dwindex.hh"
+#include "dwit.hh"
+#include "fdstream.hh"
 #include "op.hh"
+#include "overload.hh"
 #include "parser.hh"
+#include "profile.hh"
 #include "stack.hh"
 #include "tree.hh"
 #include "value-dw.hh"
+#include "writer.hh"
 
 static void
 show_help ()
@@ -53,11 +65,360 @@ show_help ()
 -H, --with-filename	print the filename for each match\n\
 -h, --no-filename	suppress printing filename on output\n\
 -c, --count		print only a count of query results\n\
+-j, --jobs=N		use N threads for processing input files\n\
+    --format=FMT	write results as text (the default), as JSON\n\
+			lines (jsonl), or as binary records (binary)\n\
+    --profile		show call counts and time spent in each part of\n\
+			the query on stderr when done\n\
+\n\
+    --index-dir=DIR	look up DIE indices in DIR\n\
+    --make-index	write DIE indices of input files to the index\n\
+			directory instead of running a query\n\
 \n\
     --help		this message\n\
 ";
 }
 
+namespace
+{
+  struct grep_options
+  {
+    int verbosity = 0;
+    bool no_messages = false;
+    bool show_count = false;
+    bool with_filename = false;
+    // Flush output after each result, as is done on a terminal.
+    bool line_buffered = false;
+    output_format format = output_format::text;
+  };
+
+  // Outcome of running the query on one input file, or a slice of
+  // one.
+  struct file_status
+  {
+    uint64_t count = 0;
+    bool opened = false;
+    bool match = false;
+    bool errors = false;
+    // Evaluation was cut short by an error.
+    bool failed = false;
+  };
+
+  // A piece of work for grep_file.  Normally that's a whole file, but
+  // when there are few files and many threads, a file can be split to
+  // several jobs, each covering a range of its units.
+  struct grep_job
+  {
+    size_t file;
+    size_t unit_begin;
+    size_t unit_end;
+    // Whether this is the last job for the file.
+    bool last;
+
+    explicit grep_job (size_t a_file)
+      : file {a_file}
+      , unit_begin {0}
+      , unit_end {(size_t) -1}
+      , last {true}
+    {}
+  };
+
+  // How many results to ask of the program at once.
+  size_t const batch_size = 16;
+
+  // Run QUERY on units [UNIT_BEGIN, UNIT_END) of file FN.  Normal
+  // output goes to OUT, diagnostics to ERR.  In quiet mode, stop at
+  // the first match.  Evaluation is also cut short when QUIT becomes
+  // set, which is how parallel workers learn that another job has
+  // already matched under -q.
+  file_status
+  grep_file (std::string const &fn, size_t unit_begin, size_t unit_end,
+	     tree const &query, grep_options const &opts,
+	     std::ostream &out, std::ostream &err,
+	     std::atomic <bool> const &quit)
+  {
+    file_status ret;
+    auto stk = std::make_unique <stack> ();
+
+    std::unique_ptr <value_dwarf> vdw;
+    try
+      {
+	vdw = std::make_unique <value_dwarf> (fn, 0);
+      }
+    catch (std::runtime_error const &e)
+      {
+	// Structured output must not have messages mixed in.
+	if (! opts.no_messages)
+	  (opts.format == output_format::text ? out : err)
+	    << "dwgrep: " << fn << ": " << e.what () << std::endl;
+	if (opts.verbosity >= 0)
+	  ret.errors = true;
+	return ret;
+      }
+
+    ret.opened = true;
+    vdw->restrict_units (unit_begin, unit_end);
+    stk->push (std::move (vdw));
+    auto upstream = std::make_shared <op_origin> (std::move (stk));
+    auto program = query.build_exec (upstream);
+
+    // In quiet mode, the first result is all that's needed.  When
+    // the output is line buffered, results are shown as soon as they
+    // are found.
+    size_t batch = opts.verbosity < 0 || opts.line_buffered
+      ? 1 : batch_size;
+    std::vector <stack::uptr> results;
+    while (! quit && ! ret.failed)
+      {
+	// Results that precede an error are still shown, so the error
+	// is only reported after them.
+	std::string error;
+	results.clear ();
+	try
+	  {
+	    if (program->next_batch (results, batch) == 0)
+	      break;
+	  }
+	catch (std::runtime_error const &e)
+	  {
+	    error = e.what ();
+	    ret.failed = true;
+	  }
+
+	for (auto &result: results)
+	  {
+	    ret.match = true;
+
+	    // grep: Exit immediately with zero status if any match is
+	    // found, even if an error was detected.  The caller takes
+	    // care of the exiting.
+	    if (opts.verbosity < 0)
+	      return ret;
+
+	    if (opts.show_count)
+	      ++ret.count;
+	    else if (opts.format != output_format::text)
+	      write_result (out, opts.format, fn, *result);
+	    else
+	      {
+		if (opts.with_filename)
+		  out << fn << ":\n";
+		if (result->size () > 1)
+		  out << "---\n";
+		while (result->size () > 0)
+		  out << *result->pop () << '\n';
+	      }
+
+	    if (opts.line_buffered)
+	      out.flush ();
+	  }
+
+	if (ret.failed)
+	  {
+	    out.flush ();
+	    err << "dwgrep: " << fn << ": " << error << std::endl;
+	  }
+      }
+
+    return ret;
+  }
+
+  void
+  show_count (std::ostream &out, std::string const &fn, uint64_t count,
+	      grep_options const &opts)
+  {
+    if (opts.with_filename)
+      out << fn << ":";
+    out << std::dec << count << '\n';
+  }
+
+  // A query can be split across units if it starts by applying entry
+  // or unit (or one of their reduced forms) on the Dwarf itself.
+  // Results of such a query are the results for each unit in turn,
+  // and each job can compute those for its units independently.
+  // Positions would restart at zero in each job though, so queries
+  // that mention pos are not split.
+  bool
+  splittable (tree const &query)
+  {
+    tree const &first = query.m_tt == tree_type::CAT
+      ? query.m_children.front () : query;
+    if (first.m_tt != tree_type::F_BUILTIN)
+      return false;
+
+    // Unless the query was optimized, the builtin is not yet pegged
+    // to the overload that it will run.
+    std::shared_ptr <builtin const> bi = first.m_builtin;
+    if (auto ob = std::dynamic_pointer_cast <overloaded_builtin const> (bi))
+      {
+	stack_shape shape;
+	shape.push (value_dwarf::vtype.code ());
+	bi = ob->peg (shape);
+      }
+
+    return bi != nullptr && bi->splits_by_unit ()
+      && ! query.mentions_builtin ("pos");
+  }
+
+  // Number of units in FN.  Errors are ignored, they will be reported
+  // when the file is actually processed.
+  size_t
+  count_units (std::string const &fn)
+  {
+    try
+      {
+	value_dwarf vdw {fn, 0};
+	size_t ret = 0;
+	for (dwfl_module_iterator modit {vdw.get_dwctx ()->get_dwfl ()};
+	     modit != dwfl_module_iterator::end (); ++modit)
+	  for (cu_iterator cuit {(*modit).first};
+	       cuit != cu_iterator::end (); ++cuit)
+	    ++ret;
+	return ret;
+      }
+    catch (std::runtime_error const &e)
+      {
+	return 0;
+      }
+  }
+
+  std::vector <grep_job>
+  plan_jobs (std::vector <std::string> const &to_process,
+	     tree const &query, unsigned jobs)
+  {
+    std::vector <grep_job> ret;
+    bool split = to_process.size () < jobs && splittable (query);
+
+    for (size_t i = 0; i < to_process.size (); ++i)
+      {
+	// Make more slices than threads, units vary in size a lot.
+	size_t units = split ? count_units (to_process[i]) : 0;
+	size_t slices = std::min (units, (size_t) jobs * 4);
+	if (slices <= 1)
+	  {
+	    ret.push_back (grep_job {i});
+	    continue;
+	  }
+
+	for (size_t j = 0; j < slices; ++j)
+	  {
+	    grep_job job {i};
+	    job.unit_begin = units * j / slices;
+	    job.unit_end = units * (j + 1) / slices;
+	    job.last = j + 1 == slices;
+	    ret.push_back (job);
+	  }
+      }
+
+    return ret;
+  }
+
+  // Output of one job processed by a parallel worker.  It is kept
+  // aside until all jobs before it have been printed, so that the
+  // output looks the same as if the files were processed in order.
+  struct job_output
+  {
+    std::ostringstream out;
+    std::ostringstream err;
+    file_status status;
+    bool done = false;
+  };
+
+  // Process TO_PROCESS with JOBS worker threads.  Each worker builds
+  // its own program for each job, and each job opens the file
+  // anew, and thus has its own dwfl_context with its own caches.
+  // The query tree is shared between threads read-only.  Besides
+  // that, only process-wide state is shared, which therefore has to
+  // be per-thread (as are value pools and formatting buffers) or
+  // locked (as is the profile registry).  Output of the jobs is then
+  // written to OUT in order.
+  file_status
+  grep_files_parallel (std::vector <std::string> const &to_process,
+		       tree const &query, grep_options const &opts,
+		       std::vector <grep_job> const &plan, unsigned jobs,
+		       std::ostream &out)
+  {
+    std::vector <job_output> outputs (plan.size ());
+    std::atomic <size_t> next {0};
+    std::atomic <bool> quit {false};
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    auto worker = [&] ()
+      {
+	for (size_t i; ! quit && (i = next++) < plan.size (); )
+	  {
+	    grep_job const &job = plan[i];
+	    job_output &o = outputs[i];
+	    file_status st = grep_file (to_process[job.file],
+					job.unit_begin, job.unit_end,
+					query, opts, o.out, o.err, quit);
+	    if (st.match && opts.verbosity < 0)
+	      quit = true;
+
+	    std::lock_guard <std::mutex> lock {mtx};
+	    o.status = st;
+	    o.done = true;
+	    cv.notify_all ();
+	  }
+      };
+
+    std::vector <std::thread> threads;
+    for (unsigned i = 0; i < jobs && i < plan.size (); ++i)
+      threads.emplace_back (worker);
+
+    file_status ret;
+    file_status file;
+    for (size_t i = 0; i < plan.size (); ++i)
+      {
+	job_output &o = outputs[i];
+	{
+	  std::unique_lock <std::mutex> lock {mtx};
+	  cv.wait (lock, [&] () { return o.done || quit; });
+	}
+
+	if (quit)
+	  {
+	    ret.match = true;
+	    break;
+	  }
+
+	// Sequential processing would stop at the first error in a
+	// file, so drop whatever later slices of that file produced.
+	if (! file.failed)
+	  {
+	    out << o.out.str ();
+	    if (o.err.tellp () > 0 || opts.line_buffered)
+	      out.flush ();
+	    if (o.err.tellp () > 0)
+	      std::cerr << o.err.str ();
+	    file.count += o.status.count;
+	    file.opened = o.status.opened;
+	    file.failed = o.status.failed;
+	    ret.match = ret.match || o.status.match;
+	    ret.errors = ret.errors || o.status.errors;
+	  }
+
+	// Release the buffers early, the output may be large.
+	o.out.str ("");
+	o.err.str ("");
+
+	if (plan[i].last)
+	  {
+	    if (opts.show_count && file.opened)
+	      show_count (out, to_process[plan[i].file], file.count, opts);
+	    out.flush ();
+	    file = file_status {};
+	  }
+      }
+
+    for (auto &thread: threads)
+      thread.join ();
+
+    return ret;
+  }
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -70,6 +431,10 @@ main(int argc, char *argv[])
   {
     verbose_flag = 257,
     help_flag,
+    index_dir_flag,
+    make_index_flag,
+    profile_flag,
+    format_flag,
   };
 
   static option long_options[] = {
@@ -82,17 +447,21 @@ main(int argc, char *argv[])
     {"with-filename", no_argument, nullptr, 'H'},
     {"no-filename", no_argument, nullptr, 'h'},
     {"file", required_argument, nullptr, 'f'},
+    {"jobs", required_argument, nullptr, 'j'},
     {"help", no_argument, nullptr, help_flag},
+    {"index-dir", required_argument, nullptr, index_dir_flag},
+    {"make-index", no_argument, nullptr, make_index_flag},
+    {"profile", no_argument, nullptr, profile_flag},
+    {"format", required_argument, nullptr, format_flag},
     {nullptr, no_argument, nullptr, 0},
   };
-  static char const *options = "ce:Hhqsf:O:";
+  static char const *options = "ce:Hhqsf:O:j:";
 
-  int verbosity = 0;
-  bool no_messages = false;
-  bool show_count = false;
-  bool with_filename = false;
+  grep_options opts;
   bool no_filename = false;
   bool optimize = true;
+  bool make_index = false;
+  unsigned jobs = 1;
 
   std::vector <std::string> to_process;
 
@@ -115,11 +484,11 @@ main(int argc, char *argv[])
 	  break;
 
 	case 'c':
-	  show_count = true;
+	  opts.show_count = true;
 	  break;
 
 	case 'H':
-	  with_filename = true;
+	  opts.with_filename = true;
 	  break;
 
 	case 'h':
@@ -127,11 +496,11 @@ main(int argc, char *argv[])
 	  break;
 
 	case 'q':
-	  verbosity = -1;
+	  opts.verbosity = -1;
 	  break;
 
 	case verbose_flag:
-	  verbosity = 1;
+	  opts.verbosity = 1;
 	  break;
 
 	case help_flag:
@@ -139,7 +508,33 @@ main(int argc, char *argv[])
 	  return 0;
 
 	case 's':
-	  no_messages = true;
+	  opts.no_messages = true;
+	  break;
+
+	case index_dir_flag:
+	  die_index::set_directory (optarg);
+	  break;
+
+	case make_index_flag:
+	  make_index = true;
+	  break;
+
+	case profile_flag:
+	  profile::enable ();
+	  break;
+
+	case format_flag:
+	  if (std::string {optarg} == "text")
+	    opts.format = output_format::text;
+	  else if (std::string {optarg} == "jsonl")
+	    opts.format = output_format::jsonl;
+	  else if (std::string {optarg} == "binary")
+	    opts.format = output_format::binary;
+	  else
+	    {
+	      std::cerr << "Unknown output format " << optarg << std::endl;
+	      return 2;
+	    }
 	  break;
 
 	case 'f':
@@ -164,6 +559,19 @@ main(int argc, char *argv[])
 	    }
 	  break;
 
+	case 'j':
+	  {
+	    char *end;
+	    long n = strtol (optarg, &end, 10);
+	    if (*optarg == '\0' || *end != '\0' || n < 1)
+	      {
+		std::cerr << "Invalid number of jobs " << optarg << std::endl;
+		return 2;
+	      }
+	    jobs = n;
+	    break;
+	  }
+
 	default:
 	  std::exit (2);
 	}
@@ -172,6 +580,40 @@ main(int argc, char *argv[])
   argc -= optind;
   argv += optind;
 
+  if (make_index)
+    {
+      if (die_index::directory ().empty ())
+	{
+	  std::cerr << "--make-index needs --index-dir.\n";
+	  return 2;
+	}
+      if (argc == 0)
+	{
+	  std::cerr << "No input files.\n";
+	  return 2;
+	}
+
+      bool errors = false;
+      for (int i = 0; i < argc; ++i)
+	try
+	  {
+	    value_dwarf vdw {argv[i], 0};
+	    if (vdw.get_dwctx ()->write_indices () == 0
+		&& ! opts.no_messages)
+	      std::cerr << "dwgrep: " << argv[i]
+			<< ": no build ID, not indexed" << std::endl;
+	  }
+	catch (std::runtime_error const &e)
+	  {
+	    if (! opts.no_messages)
+	      std::cerr << "dwgrep: " << argv[i] << ": "
+			<< e.what () << std::endl;
+	    errors = true;
+	  }
+
+      return errors ? 2 : 0;
+    }
+
   if (! seen_query)
     {
       if (argc == 0)
@@ -184,9 +626,17 @@ main(int argc, char *argv[])
     }
 
   if (optimize)
-    query.simplify ();
+    {
+      query.simplify ();
 
-  if (verbosity > 0)
+      // Every query starts off a stack with just the Dwarf on it.
+      stack_shape shape;
+      shape.push (value_dwarf::vtype.code ());
+      query.peg_overloads (shape);
+      query.reduce_strength ();
+    }
+
+  if (opts.verbosity > 0)
     std::cerr << query << std::endl;
 
   if (argc == 0)
@@ -199,83 +649,70 @@ main(int argc, char *argv[])
       to_process.push_back (argv[i]);
 
   if (to_process.size () > 1)
-    with_filename = true;
+    opts.with_filename = true;
   if (no_filename)
-    with_filename = false;
+    opts.with_filename = false;
+
+  // Results are written through a large buffer, which is flushed at
+  // file boundaries.  std::exit doesn't destroy locals, so it needs
+  // to be flushed explicitly before exiting.  On a terminal, like
+  // grep, flush after each result instead, so that results are not
+  // held back and show up before warnings that follow them.
+  fd_ostream out {STDOUT_FILENO};
+  opts.line_buffered = isatty (STDOUT_FILENO);
+  auto done = [&out] (int status)
+    {
+      out.flush ();
+      if (profile::enabled ())
+	profile::report (std::cerr);
+      std::exit (status);
+    };
+
+  // Counts are always shown as text.
+  if (! opts.show_count)
+    begin_output (out, opts.format);
 
   bool errors = false;
   bool match = false;
-  for (auto const &fn: to_process)
+  std::vector <grep_job> plan;
+  if (jobs > 1)
     {
-      auto stk = std::make_unique <stack> ();
-
-      std::unique_ptr <value_dwarf> vdw;
-      try
-	{
-	  vdw = std::make_unique <value_dwarf> (fn, 0);
-	}
-      catch (std::runtime_error e)
-	{
-	  if (! no_messages)
-	    std::cout << "dwgrep: " << fn << ": " << e.what () << std::endl;
-	  if (verbosity >= 0)
-	    errors = true;
-	  continue;
-	}
-
-      stk->push (std::move (vdw));
-      auto upstream = std::make_shared <op_origin> (std::move (stk));
-      auto program = query.build_exec (upstream);
-
-      uint64_t count = 0;
-      while (true)
-	{
-	  stack::uptr result;
-	  try
-	    {
-	      result = program->next ();
-	    }
-	  catch (std::runtime_error e)
-	    {
-	      std::cerr << "dwgrep: " << fn << ": " << e.what () << std::endl;
-	      break;
-	    }
-
-	  if (result == nullptr)
-	    break;
-
-	  // grep: Exit immediately with zero status if any match
-	  // is found, even if an error was detected.
-	  if (verbosity < 0)
-	    std::exit (0);
-
-	  match = true;
-	  if (! show_count)
-	    {
-	      if (with_filename)
-		std::cout << fn << ":\n";
-	      if (result->size () > 1)
-		std::cout << "---\n";
-	      while (result->size () > 0)
-		std::cout << *result->pop () << std::endl;
-	    }
-	  else
-	    ++count;
-	}
+      plan = plan_jobs (to_process, query, jobs);
+      if (opts.verbosity > 0)
+	std::cerr << plan.size () << " jobs" << std::endl;
+    }
 
-      if (show_count)
+  if (plan.size () > 1)
+    {
+      file_status st = grep_files_parallel (to_process, query, opts,
+					    plan, jobs, out);
+      if (st.match && opts.verbosity < 0)
+	done (0);
+      errors = st.errors;
+      match = st.match;
+    }
+  else
+    {
+      std::atomic <bool> quit {false};
+      for (auto const &fn: to_process)
 	{
-	  if (with_filename)
-	    std::cout << fn << ":";
-	  std::cout << std::dec << count << std::endl;
+	  file_status st = grep_file (fn, 0, (size_t) -1, query, opts,
+				      out, std::cerr, quit);
+	  if (st.match && opts.verbosity < 0)
+	    done (0);
+	  if (opts.show_count && st.opened)
+	    show_count (out, fn, st.count, opts);
+	  out.flush ();
+	  errors = errors || st.errors;
+	  match = match || st.match;
 	}
     }
 
   if (errors)
-    std::exit (2);
+    done (2);
 
   if (match)
-    std::exit (0);
+    done (0);
   else
-    std::exit (1);
+    done (1);
 }
@@ -0,0 +1,325 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "dwindex.hh"
+#include "dwit.hh"
+#include "dwpp.hh"
+
+struct die_index::header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t build_id_len;
+  unsigned char build_id[64];
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t file_size;
+  uint64_t n_units;
+  uint64_t n_dies;
+  uint64_t strings_size;
+};
+
+namespace
+{
+  char const index_magic[8] = {'D', 'W', 'G', 'R', 'E', 'P', 'I', 'X'};
+  uint32_t const index_version = 1;
+
+  std::string s_directory;
+
+  std::string
+  index_path (std::string const &build_id)
+  {
+    static char const digits[] = "0123456789abcdef";
+    std::string ret = s_directory + "/";
+    for (unsigned char c: build_id)
+      {
+	ret += digits[c >> 4];
+	ret += digits[c & 0xf];
+      }
+    return ret + ".dwgrep-index";
+  }
+
+  std::runtime_error
+  errno_error (std::string const &what)
+  {
+    return std::runtime_error
+      (what + ": " + std::error_code (errno, std::system_category ()).message ());
+  }
+
+  struct index_builder
+  {
+    std::vector <die_index::unit_rec> m_units;
+    std::vector <die_index::die_rec> m_dies;
+    std::string m_strings;
+    std::unordered_map <std::string, uint32_t> m_names;
+
+    uint32_t
+    intern (char const *name)
+    {
+      auto it = m_names.find (name);
+      if (it != m_names.end ())
+	return it->second;
+
+      uint32_t ret = m_strings.size ();
+      m_strings.append (name, strlen (name) + 1);
+      m_names.insert (std::make_pair (name, ret));
+      return ret;
+    }
+
+    void
+    add_dies (Dwarf_Die die, Dwarf_Off paroff)
+    {
+      while (true)
+	{
+	  Dwarf_Off off = dwarf_dieoffset (&die);
+
+	  Dwarf_Attribute at;
+	  char const *name = nullptr;
+	  if (dwarf_attr (&die, DW_AT_name, &at) != nullptr)
+	    name = dwarf_formstring (&at);
+
+	  m_dies.push_back (die_index::die_rec
+			    {off, paroff, (uint32_t) dwarf_tag (&die),
+			     name != nullptr ? intern (name)
+					     : die_index::no_name});
+
+	  if (dwarf_haschildren (&die))
+	    {
+	      Dwarf_Die child;
+	      if (dwarf_child (&die, &child) != 0)
+		throw_libdw ();
+	      add_dies (child, off);
+	    }
+
+	  switch (dwarf_siblingof (&die, &die))
+	    {
+	    case 0:
+	      break;
+	    case -1:
+	      throw_libdw ();
+	    case 1:
+	      return;
+	    }
+	}
+    }
+
+    explicit index_builder (Dwarf *dw)
+    {
+      for (auto it = cu_iterator {dw}; it != cu_iterator::end (); ++it)
+	{
+	  uint64_t first = m_dies.size ();
+	  add_dies (**it, die_index::no_off);
+	  m_units.push_back (die_index::unit_rec
+			     {it.offset (), first, m_dies.size () - first});
+	}
+    }
+  };
+}
+
+std::string const &
+die_index::directory ()
+{
+  return s_directory;
+}
+
+void
+die_index::set_directory (std::string const &dir)
+{
+  s_directory = dir;
+}
+
+die_index::die_index (void *base, size_t size)
+  : m_base {base}
+  , m_size {size}
+  , m_header {static_cast <header const *> (base)}
+  , m_units {reinterpret_cast <unit_rec const *> (m_header + 1)}
+  , m_dies {reinterpret_cast <die_rec const *>
+	      (m_units + m_header->n_units)}
+  , m_strings {reinterpret_cast <char const *> (m_dies + m_header->n_dies)}
+{}
+
+die_index::~die_index ()
+{
+  munmap (m_base, m_size);
+}
+
+std::unique_ptr <die_index>
+die_index::open (std::string const &build_id, struct stat const &st)
+{
+  if (s_directory.empty () || build_id.size () > sizeof header::build_id)
+    return nullptr;
+
+  int fd = ::open (index_path (build_id).c_str (), O_RDONLY);
+  if (fd == -1)
+    return nullptr;
+
+  struct stat ist;
+  void *base = MAP_FAILED;
+  if (fstat (fd, &ist) == 0 && (size_t) ist.st_size >= sizeof (header))
+    base = mmap (nullptr, ist.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    return nullptr;
+
+  size_t size = ist.st_size;
+  auto hdr = static_cast <header const *> (base);
+
+  // Check that the index is for this very file, and that the sizes
+  // recorded in the header add up.
+  size_t avail = size - sizeof (header);
+  bool ok = memcmp (hdr->magic, index_magic, sizeof index_magic) == 0
+    && hdr->version == index_version
+    && hdr->build_id_len == build_id.size ()
+    && memcmp (hdr->build_id, build_id.data (), build_id.size ()) == 0
+    && hdr->mtime_sec == st.st_mtim.tv_sec
+    && hdr->mtime_nsec == st.st_mtim.tv_nsec
+    && hdr->file_size == (uint64_t) st.st_size
+    && hdr->n_units <= avail / sizeof (unit_rec)
+    && hdr->n_dies <= avail / sizeof (die_rec)
+    && (hdr->n_units * sizeof (unit_rec) + hdr->n_dies * sizeof (die_rec)
+	+ hdr->strings_size) == avail;
+
+  std::unique_ptr <die_index> ret {ok ? new die_index (base, size) : nullptr};
+  if (ret == nullptr)
+    {
+      munmap (base, size);
+      return nullptr;
+    }
+
+  // String table needs to be terminated, and units need to refer to
+  // DIEs that are there.
+  if (hdr->strings_size > 0 && ret->m_strings[hdr->strings_size - 1] != 0)
+    return nullptr;
+
+  for (uint64_t i = 0; i < hdr->n_units; ++i)
+    if (ret->m_units[i].first > hdr->n_dies
+	|| ret->m_units[i].count > hdr->n_dies - ret->m_units[i].first)
+      return nullptr;
+
+  return ret;
+}
+
+void
+die_index::write (Dwarf *dw, std::string const &build_id,
+		  struct stat const &st)
+{
+  if (s_directory.empty ())
+    throw std::runtime_error ("No index directory given.");
+  if (build_id.size () > sizeof header::build_id)
+    throw std::runtime_error ("Build ID too long.");
+
+  index_builder bld {dw};
+
+  header hdr = {};
+  memcpy (hdr.magic, index_magic, sizeof index_magic);
+  hdr.version = index_version;
+  hdr.build_id_len = build_id.size ();
+  memcpy (hdr.build_id, build_id.data (), build_id.size ());
+  hdr.mtime_sec = st.st_mtim.tv_sec;
+  hdr.mtime_nsec = st.st_mtim.tv_nsec;
+  hdr.file_size = st.st_size;
+  hdr.n_units = bld.m_units.size ();
+  hdr.n_dies = bld.m_dies.size ();
+  hdr.strings_size = bld.m_strings.size ();
+
+  // Write to a temporary file and rename it over the index, so that
+  // nobody ever sees a half-written one.
+  std::string path = index_path (build_id);
+  std::string tmp = path + "." + std::to_string (getpid ());
+  {
+    std::ofstream ofs {tmp, std::ios::binary | std::ios::trunc};
+    ofs.write (reinterpret_cast <char const *> (&hdr), sizeof hdr);
+    ofs.write (reinterpret_cast <char const *> (bld.m_units.data ()),
+	       bld.m_units.size () * sizeof (unit_rec));
+    ofs.write (reinterpret_cast <char const *> (bld.m_dies.data ()),
+	       bld.m_dies.size () * sizeof (die_rec));
+    ofs.write (bld.m_strings.data (), bld.m_strings.size ());
+    ofs.close ();
+    if (! ofs)
+      {
+	unlink (tmp.c_str ());
+	throw errno_error (tmp);
+      }
+  }
+
+  if (rename (tmp.c_str (), path.c_str ()) != 0)
+    {
+      auto err = errno_error (path);
+      unlink (tmp.c_str ());
+      throw err;
+    }
+}
+
+die_index::unit_rec const *
+die_index::find_unit (Dwarf_Off offset) const
+{
+  auto end = m_units + m_header->n_units;
+  auto it = std::lower_bound (m_units, end, offset,
+			      [] (unit_rec const &u, Dwarf_Off off)
+			      {
+				return u.offset < off;
+			      });
+  if (it == end || it->offset != offset)
+    return nullptr;
+  return it;
+}
+
+die_index::die_rec const *
+die_index::find_die (Dwarf_Off offset) const
+{
+  auto end = m_dies + m_header->n_dies;
+  auto it = std::lower_bound (m_dies, end, offset,
+			      [] (die_rec const &d, Dwarf_Off off)
+			      {
+				return d.offset < off;
+			      });
+  if (it == end || it->offset != offset)
+    return nullptr;
+  return it;
+}
+
+char const *
+die_index::name (die_rec const &d) const
+{
+  if (d.name == no_name || d.name >= m_header->strings_size)
+    return nullptr;
+  return m_strings + d.name;
+}
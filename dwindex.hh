@@ -0,0 +1,117 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _DWINDEX_H_
+#define _DWINDEX_H_
+
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <elfutils/libdw.h>
+
+// A DIE index is a sidecar file that records, for every DIE of a
+// Dwarf, its offset, the offset of its parent, its tag, and its
+// DW_AT_name, if any.  Names are interned in a string table.  Queries
+// that would otherwise have to walk the DIE tree (such as finding a
+// parent, or enumerating DIEs of a unit) can consult the index
+// instead.
+//
+// Indices are kept in a directory and named after the build ID of
+// the Dwarf that they describe.  An index also records modification
+// time and size of the file that was indexed, and is ignored if those
+// don't match.  The index is memory-mapped, its records are stored
+// in host byte order.
+class die_index
+{
+public:
+  struct unit_rec
+  {
+    uint64_t offset;	// Offset of the unit header.
+    uint64_t first;	// Index of the first DIE of the unit.
+    uint64_t count;	// Number of DIEs in the unit.
+  };
+
+  struct die_rec
+  {
+    uint64_t offset;
+    uint64_t parent;	// no_off for unit DIEs.
+    uint32_t tag;
+    uint32_t name;	// Offset in string table, or no_name.
+  };
+
+  static Dwarf_Off const no_off = (Dwarf_Off) -1;
+  static uint32_t const no_name = (uint32_t) -1;
+
+private:
+  struct header;
+
+  void *m_base;
+  size_t m_size;
+  header const *m_header;
+  unit_rec const *m_units;
+  die_rec const *m_dies;
+  char const *m_strings;
+
+  die_index (void *base, size_t size);
+
+public:
+  ~die_index ();
+
+  // Directory where indices are looked up and written.  When it's
+  // empty, which is the default, indices are not used.
+  static std::string const &directory ();
+  static void set_directory (std::string const &dir);
+
+  // Open index of a Dwarf with BUILD_ID, which was found in a file
+  // with status ST.  Returns nullptr if there's no such index, or if
+  // it's stale or otherwise unusable.
+  static std::unique_ptr <die_index> open (std::string const &build_id,
+					   struct stat const &st);
+
+  // Index DIEs of DW, which has BUILD_ID and was found in a file with
+  // status ST.  Throws if the index can't be written.
+  static void write (Dwarf *dw, std::string const &build_id,
+		     struct stat const &st);
+
+  // Find a unit whose header is at OFFSET, or a DIE at OFFSET.
+  // Returns nullptr if there's none.
+  unit_rec const *find_unit (Dwarf_Off offset) const;
+  die_rec const *find_die (Dwarf_Off offset) const;
+
+  // DIEs of unit U, in the order of a pre-order walk.
+  die_rec const *begin (unit_rec const &u) const
+  { return m_dies + u.first; }
+
+  die_rec const *end (unit_rec const &u) const
+  { return m_dies + u.first + u.count; }
+
+  // DW_AT_name of the DIE that D describes, or nullptr.
+  char const *name (die_rec const &d) const;
+};
+
+#endif /* _DWINDEX_H_ */
@@ -278,7 +278,7 @@ public:
     return !(*this == other);
   }
 
-  all_dies_iterator
+  all_dies_iterator &
   operator++ ()
   {
     if (dwarf_haschildren (&m_die))
@@ -357,103 +357,157 @@ public:
   }
 };
 
-class attr_iterator
-  : public std::iterator<std::input_iterator_tag, Dwarf_Attribute *>
+// Pre-order walk through DIEs of one unit.  Unlike all_dies_iterator,
+// this keeps the DIEs on the path to the current one, so climbing out
+// of a subtree needs no decoding, and the parent and depth of the
+// current DIE are known.  It's meant to be held in place and reused,
+// the path storage is only ever allocated when a walker first needs
+// to go deeper than it did so far.
+class die_walker
 {
-  Dwarf_Die *m_die;
-  Dwarf_Attribute m_at;
-  ptrdiff_t m_offset;
-
-  struct cb_data
-  {
-    Dwarf_Attribute *at;
-    bool been;
-  };
+  std::vector <Dwarf_Die> m_path;
+  bool m_started;
 
-  static int
-  callback (Dwarf_Attribute *at, void *data)
+public:
+  die_walker ()
+    : m_started {false}
   {
-    cb_data *d = static_cast<cb_data *> (data);
-    if (d->been)
-      return DWARF_CB_ABORT;
+    m_path.reserve (32);
+  }
 
-    *d->at = *at;
-    d->been = true;
+  die_walker (die_walker const &other) = delete;
 
-    // Do a second iteration to find the next offset.
-    return DWARF_CB_OK;
+  // Start over at CUDIE.
+  void
+  reset (Dwarf_Die cudie)
+  {
+    m_path.clear ();
+    m_path.push_back (cudie);
+    m_started = false;
   }
 
-  void
-  move ()
+  // Move to the next DIE and return it.  The first call yields the
+  // unit DIE itself.  Returns nullptr when the unit is exhausted.  The
+  // pointer is only valid until the next call.
+  Dwarf_Die *
+  next ()
   {
-    // If m_offset is already 1, we are done iterating.
-    if (m_offset == 1)
+    if (m_path.empty ())
+      return nullptr;
+
+    if (! m_started)
       {
-	*this = end ();
-	return;
+	m_started = true;
+	return &m_path.back ();
       }
 
-    cb_data data = {&m_at, false};
-    m_offset = dwarf_getattrs (m_die, &callback, &data, m_offset);
-    if (m_offset == -1)
-      throw_libdw ();
+    Dwarf_Die child;
+    switch (dwarf_child (&m_path.back (), &child))
+      {
+      case -1:
+	throw_libdw ();
+      case 0:
+	m_path.push_back (child);
+	return &m_path.back ();
+      }
+
+    // Unit DIEs have no siblings worth visiting.
+    while (m_path.size () > 1)
+      switch (dwarf_siblingof (&m_path.back (), &m_path.back ()))
+	{
+	case -1:
+	  throw_libdw ();
+	case 0:
+	  return &m_path.back ();
+	case 1:
+	  m_path.pop_back ();
+	}
+
+    m_path.clear ();
+    return nullptr;
   }
 
-  attr_iterator (ptrdiff_t offset)
-    : m_die (nullptr)
-    , m_at ({0})
-    , m_offset (offset)
-  {}
+  // Depth of the current DIE, 0 for the unit DIE.
+  size_t
+  depth () const
+  {
+    assert (! m_path.empty ());
+    return m_path.size () - 1;
+  }
 
-public:
-  attr_iterator (Dwarf_Die *die)
-    : m_die (die)
-    , m_at ({0})
-    , m_offset (0)
+  // Parent of the current DIE, or nullptr for the unit DIE.
+  Dwarf_Die *
+  parent ()
   {
-    move ();
+    assert (! m_path.empty ());
+    return m_path.size () > 1 ? &m_path[m_path.size () - 2] : nullptr;
   }
+};
 
-  bool
-  operator== (attr_iterator const &other) const
+// Attributes of a DIE, decoded in a single dwarf_getattrs pass.  Most
+// DIEs have only a handful of attributes, those are kept inline.
+class die_attributes
+{
+  static size_t const inline_count = 12;
+
+  Dwarf_Attribute m_inline[inline_count];
+  std::vector <Dwarf_Attribute> m_more;
+  size_t m_size;
+
+  void
+  push (Dwarf_Attribute const &at)
   {
-    return m_offset == other.m_offset
-      && m_at.code == other.m_at.code;
+    if (m_more.empty () && m_size < inline_count)
+      m_inline[m_size] = at;
+    else
+      {
+	if (m_more.empty ())
+	  m_more.assign (m_inline, m_inline + m_size);
+	m_more.push_back (at);
+      }
+    ++m_size;
   }
 
-  bool
-  operator!= (attr_iterator const &other) const
+  static int
+  callback (Dwarf_Attribute *at, void *data)
   {
-    return !(*this == other);
+    static_cast <die_attributes *> (data)->push (*at);
+    return DWARF_CB_OK;
   }
 
-  attr_iterator &
-  operator++ ()
+public:
+  explicit die_attributes (Dwarf_Die *die)
+    : m_size {0}
   {
-    assert (*this != end ());
-    move ();
-    return *this;
+    if (dwarf_getattrs (die, &callback, this, 0) == -1)
+      throw_libdw ();
   }
 
-  attr_iterator
-  operator++ (int)
+  die_attributes (die_attributes const &other) = delete;
+
+  size_t
+  size () const
   {
-    attr_iterator tmp = *this;
-    ++*this;
-    return tmp;
+    return m_size;
   }
 
   Dwarf_Attribute *
-  operator* ()
+  begin ()
   {
-    return &m_at;
+    return m_more.empty () ? m_inline : m_more.data ();
   }
 
-  static attr_iterator
+  Dwarf_Attribute *
   end ()
   {
-    return attr_iterator ((ptrdiff_t)1);
+    return begin () + m_size;
+  }
+
+  Dwarf_Attribute &
+  operator[] (size_t i)
+  {
+    assert (i < m_size);
+    return begin ()[i];
   }
 };
 
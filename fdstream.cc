@@ -0,0 +1,86 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <cerrno>
+#include <unistd.h>
+
+#include "fdstream.hh"
+
+fd_streambuf::fd_streambuf (int fd, size_t size)
+  : m_fd {fd}
+  , m_buf (size)
+{
+  setp (m_buf.data (), m_buf.data () + m_buf.size ());
+}
+
+fd_streambuf::~fd_streambuf ()
+{
+  sync ();
+}
+
+bool
+fd_streambuf::write_out ()
+{
+  char const *p = pbase ();
+  while (p < pptr ())
+    {
+      ssize_t n = write (m_fd, p, pptr () - p);
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	{
+	  // Drop the rest, there's no way to get it out anyway.
+	  setp (m_buf.data (), m_buf.data () + m_buf.size ());
+	  return false;
+	}
+      p += n;
+    }
+
+  setp (m_buf.data (), m_buf.data () + m_buf.size ());
+  return true;
+}
+
+fd_streambuf::int_type
+fd_streambuf::overflow (int_type c)
+{
+  if (! write_out ())
+    return traits_type::eof ();
+
+  if (traits_type::eq_int_type (c, traits_type::eof ()))
+    return traits_type::not_eof (c);
+
+  *pptr () = traits_type::to_char_type (c);
+  pbump (1);
+  return c;
+}
+
+int
+fd_streambuf::sync ()
+{
+  return write_out () ? 0 : -1;
+}
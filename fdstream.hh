@@ -0,0 +1,71 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _FDSTREAM_H_
+#define _FDSTREAM_H_
+
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+// A stream buffer that writes to a file descriptor through a large
+// user-space buffer.  Unlike std::cout, it is only flushed when the
+// buffer fills up, or when asked to, which makes a difference when
+// there are many short lines of output.
+class fd_streambuf
+  : public std::streambuf
+{
+  int m_fd;
+  std::vector <char> m_buf;
+
+  bool write_out ();
+
+protected:
+  int_type overflow (int_type c) override;
+  int sync () override;
+
+public:
+  explicit fd_streambuf (int fd, size_t size = 64 * 1024);
+  ~fd_streambuf ();
+};
+
+class fd_ostream
+  : public std::ostream
+{
+  fd_streambuf m_sb;
+
+public:
+  explicit fd_ostream (int fd)
+    : std::ostream {nullptr}
+    , m_sb {fd}
+  {
+    rdbuf (&m_sb);
+  }
+};
+
+#endif /* _FDSTREAM_H_ */
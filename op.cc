@@ -29,7 +29,7 @@
 #include <iostream>
 #include <sstream>
 #include <memory>
-#include <set>
+#include <unordered_set>
 #include <algorithm>
 
 #include "op.hh"
@@ -67,7 +67,7 @@ namespace
 	std::cerr << frame;
 	std::cerr << "{";
 	for (auto const &v: frame->m_values)
-	  if (v == nullptr)
+	  if (! v)
 	    std::cerr << " (unbound)";
 	  else
 	    v->show ((std::cerr << ' '), brevity::brief);
@@ -79,6 +79,18 @@ namespace
   }
 }
 
+size_t
+op::next_batch (std::vector <stack::uptr> &out, size_t max)
+{
+  size_t n = 0;
+  for (; n < max; ++n)
+    if (auto stk = next ())
+      out.push_back (std::move (stk));
+    else
+      break;
+  return n;
+}
+
 std::unique_ptr <value>
 value_producer_cat::next ()
 {
@@ -143,6 +155,14 @@ op_assert::next ()
   return nullptr;
 }
 
+size_t
+op_assert::next_batch (std::vector <stack::uptr> &out, size_t max)
+{
+  return pull_batch (*m_upstream, out, max, [this] (stack &stk) {
+      return m_pred->result (stk) == pred_result::yes;
+    });
+}
+
 std::string
 op_assert::name () const
 {
@@ -498,13 +518,23 @@ op_capture::name () const
 
 namespace
 {
-  struct deref_less
+  struct deref_hash
+  {
+    template <class T>
+    size_t
+    operator() (T const &a) const
+    {
+      return a->hash ();
+    }
+  };
+
+  struct deref_equal
   {
     template <class T>
     bool
-    operator() (T const &a, T const &b)
+    operator() (T const &a, T const &b) const
     {
-      return *a < *b;
+      return *a == *b;
     }
   };
 }
@@ -515,7 +545,12 @@ struct op_tr_closure::pimpl
   std::shared_ptr <op_origin> m_origin;
   std::shared_ptr <op> m_op;
 
-  std::set <std::shared_ptr <stack>, deref_less> m_seen;
+  // Stacks that have been seen so far.  For the common closures over
+  // a single DIE (child*, @AT_type* and the like), the stack hash is
+  // derived from the DIE offset alone, and a probe costs at most an
+  // offset comparison.
+  std::unordered_set <std::shared_ptr <stack>,
+		      deref_hash, deref_equal> m_seen;
   std::vector <std::shared_ptr <stack> > m_stks;
 
   pimpl (std::shared_ptr <op> upstream,
@@ -564,11 +599,8 @@ struct op_tr_closure::pimpl
 	m_origin->set_next (std::make_unique <stack> (*stk));
 
 	while (std::shared_ptr <stack> stk2 = m_op->next ())
-	  if (m_seen.find (stk2) == m_seen.end ())
-	    {
-	      m_stks.push_back (stk2);
-	      m_seen.insert (stk2);
-	    }
+	  if (m_seen.insert (stk2).second)
+	    m_stks.push_back (stk2);
 
 	return std::make_unique <stack> (*stk);
       }
@@ -760,8 +792,7 @@ struct op_scope::pimpl
 	  if (auto stk = m_upstream->next ())
 	    {
 	      // Push new stack frame.
-	      stk->set_frame (std::make_shared <frame> (stk->nth_frame (0),
-							m_num_vars));
+	      stk->push_frame (m_num_vars);
 	      m_op->reset ();
 	      m_origin->set_next (std::move (stk));
 	      m_primed = true;
@@ -829,8 +860,8 @@ op_bind::next ()
 {
   if (auto stk = m_upstream->next ())
     {
-      auto frame = stk->nth_frame (m_depth);
-      frame->bind_value (m_index, stk->pop ());
+      auto val = stk->pop ();
+      stk->bind_value (m_depth, m_index, std::move (val));
       return stk;
     }
   return nullptr;
@@ -847,20 +878,26 @@ op_bind::name () const
 struct op_read::pimpl
 {
   std::shared_ptr <op> m_upstream;
-  std::shared_ptr <op> m_apply;
   size_t m_depth;
   var_id m_index;
 
+  // The apply op is made on first call and reused afterwards, so that
+  // it can keep its compiled closures.
+  std::shared_ptr <op_origin> m_origin;
+  std::shared_ptr <op> m_apply;
+  bool m_applying;
+
   pimpl (std::shared_ptr <op> upstream, size_t depth, var_id index)
     : m_upstream {upstream}
     , m_depth {depth}
     , m_index {index}
+    , m_applying {false}
   {}
 
   void
   reset_me ()
   {
-    m_apply = nullptr;
+    m_applying = false;
   }
 
   stack::uptr
@@ -868,14 +905,14 @@ struct op_read::pimpl
   {
     while (true)
       {
-	if (m_apply == nullptr)
+	if (! m_applying)
 	  {
 	    if (auto stk = m_upstream->next ())
 	      {
 		auto frame = stk->nth_frame (m_depth);
-		value &val = frame->read_value (m_index);
-		bool is_closure = val.is <value_closure> ();
-		stk->push (val.clone ());
+		shared_value const &val = frame->read_value (m_index);
+		bool is_closure = val->is <value_closure> ();
+		stk->push (val);
 
 		// If a referenced value is not a closure, then the
 		// result is just that one value.
@@ -886,14 +923,20 @@ struct op_read::pimpl
 		// reference.  We need to execute it and fetch all the
 		// values.
 
-		auto origin = std::make_shared <op_origin> (std::move (stk));
-		m_apply = std::make_shared <op_apply> (origin);
+		if (m_apply == nullptr)
+		  {
+		    m_origin = std::make_shared <op_origin> (nullptr);
+		    m_apply = std::make_shared <op_apply> (m_origin);
+		  }
+
+		m_apply->reset ();
+		m_origin->set_next (std::move (stk));
+		m_applying = true;
 	      }
 	    else
 	      return nullptr;
 	  }
 
-	assert (m_apply != nullptr);
 	if (auto stk = m_apply->next ())
 	  return stk;
 
@@ -947,7 +990,8 @@ op_lex_closure::next ()
 {
   if (auto stk = m_upstream->next ())
     {
-      stk->push (std::make_unique <value_closure> (m_t, stk->nth_frame (0), 0));
+      stk->push (std::make_unique <value_closure> (m_t, stk->capture_frame (),
+						   0));
       return stk;
     }
   return nullptr;
@@ -1142,24 +1186,166 @@ pred_subx_any::reset ()
 }
 
 
+namespace
+{
+  struct value_ptr_hash
+  {
+    size_t
+    operator() (value const *v) const
+    {
+      return v->hash ();
+    }
+  };
+
+  struct value_ptr_equal
+  {
+    bool
+    operator() (value const *a, value const *b) const
+    {
+      return a->cmp (*b) == cmp_result::equal;
+    }
+  };
+
+  // Answers whether X is equal to, less than, or greater than any of
+  // a set of values, without comparing X to each of them in turn.
+  // That only gives the same answer as ?eq, ?lt or ?gt would if all
+  // the values are of the same type as X.  Constants in addition need
+  // to be either all arithmetic, or all of one domain, as comparing
+  // across domains warns and isn't a total order.
+  class subx_join
+  {
+    cmp_result m_want;
+    value const *m_first;
+    bool m_all_same;
+    constant_dom const *m_dom;
+
+    std::unordered_set <value const *,
+			value_ptr_hash, value_ptr_equal> m_set;
+    value const *m_extreme;
+
+    static constant_dom const *
+    key_dom (value const &v)
+    {
+      if (auto cst = value::as <value_cst> (&v))
+	{
+	  constant_dom const *dom = cst->get_constant ().dom ();
+	  return dom->safe_arith () ? nullptr : dom;
+	}
+      return nullptr;
+    }
+
+  public:
+    subx_join (cmp_result want,
+	       std::vector <std::unique_ptr <value>> const &ys)
+      : m_want {want}
+      , m_first {ys.empty () ? nullptr : ys.front ().get ()}
+      , m_all_same {m_first != nullptr}
+      , m_dom {m_first != nullptr ? key_dom (*m_first) : nullptr}
+      , m_extreme {nullptr}
+    {
+      if (m_all_same && m_want != cmp_result::equal
+	  && m_first->is <value_seq> ())
+	// Sequences compare their elements, which might be constants
+	// of mixed domains.
+	m_all_same = false;
+
+      for (auto const &y: ys)
+	if (y->get_type () != m_first->get_type ()
+	    || key_dom (*y) != m_dom)
+	  {
+	    m_all_same = false;
+	    break;
+	  }
+
+      if (! m_all_same)
+	return;
+
+      if (m_want == cmp_result::equal)
+	for (auto const &y: ys)
+	  m_set.insert (y.get ());
+      else
+	{
+	  // X < Y for some Y iff X < max Y, and likewise for >.
+	  cmp_result better = m_want == cmp_result::less
+	    ? cmp_result::greater : cmp_result::less;
+	  m_extreme = m_first;
+	  for (auto const &y: ys)
+	    if (y->cmp (*m_extreme) == better)
+	      m_extreme = y.get ();
+	}
+    }
+
+    // Returns pred_result::fail if X can't be answered this way.
+    pred_result
+    probe (value const &x) const
+    {
+      if (! m_all_same || x.get_type () != m_first->get_type ()
+	  || key_dom (x) != m_dom)
+	return pred_result::fail;
+
+      if (m_want == cmp_result::equal)
+	return pred_result (m_set.find (&x) != m_set.end ());
+      else
+	return pred_result (x.cmp (*m_extreme) == m_want);
+    }
+  };
+}
+
 pred_result
 pred_subx_compare::result (stack &stk)
 {
   m_op1->reset ();
   m_origin->set_next (std::make_unique <stack> (stk));
-  while (auto stk_1 = m_op1->next ())
+
+  auto stk_1 = m_op1->next ();
+  if (stk_1 == nullptr)
+    return pred_result::no;
+
+  // Evaluate OP2 for the first result of OP1, and keep the values
+  // around for the rest.
+  std::vector <std::unique_ptr <value>> ys;
+  m_op2->reset ();
+  m_origin->set_next (std::make_unique <stack> (stk));
+
+  while (auto stk_2 = m_op2->next ())
     {
-      m_op2->reset ();
-      m_origin->set_next (std::make_unique <stack> (stk));
+      stk_1->push (stk_2->pop ());
 
-      while (auto stk_2 = m_op2->next ())
+      if (m_pred->result (*stk_1) == pred_result::yes)
+	return pred_result::yes;
+
+      ys.push_back (stk_1->pop ());
+    }
+
+  std::unique_ptr <subx_join> join;
+  while ((stk_1 = m_op1->next ()))
+    {
+      if (m_want != cmp_result::fail)
 	{
-	  stk_1->push (stk_2->pop ());
+	  if (join == nullptr)
+	    join = std::make_unique <subx_join> (m_want, ys);
+
+	  pred_result r = join->probe (stk_1->top ());
+	  if (r == pred_result::yes)
+	    return r;
+	  else if (r == pred_result::no)
+	    continue;
+	}
 
-	  if (m_pred->result (*stk_1) == pred_result::yes)
-	    return pred_result::yes;
+      for (auto &y: ys)
+	{
+	  value const *orig = y.get ();
+	  stk_1->push (std::move (y));
+	  bool match = m_pred->result (*stk_1) == pred_result::yes;
+	  y = stk_1->pop ();
 
-	  stk_1->pop ();
+	  // If the predicate held on to the value, we got a clone
+	  // back, and JOIN now refers to a dead value.
+	  if (y.get () != orig)
+	    join = nullptr;
+
+	  if (match)
+	    return pred_result::yes;
 	}
     }
 
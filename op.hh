@@ -31,6 +31,8 @@
 
 #include <memory>
 #include <cassert>
+#include <exception>
+#include <vector>
 
 #include "dwgrep.hh"
 #include "stack.hh"
@@ -49,7 +51,64 @@ public:
   virtual stack::uptr next () = 0;
   virtual void reset () = 0;
   virtual std::string name () const = 0;
-};
+
+  // Produce up to MAX next values and append them to OUT.  Returns
+  // the number of values appended, which is zero only when the op is
+  // exhausted.  If this throws, whatever was appended to OUT before
+  // are valid results that precede the error.  The default calls
+  // next repeatedly, ops on hot paths override this to amortize the
+  // calls along the pipeline.  An op should be driven either through
+  // next, or through next_batch, but not both.
+  virtual size_t next_batch (std::vector <stack::uptr> &out, size_t max);
+};
+
+// Have UPSTREAM append a batch to OUT, and pass each new stack to F,
+// which may change it in place.  Stacks for which F returns false are
+// dropped.  Returns the number of stacks kept, asking upstream for
+// more batches while none are.  Stacks that upstream appended before
+// throwing still go through F before the exception is rethrown.
+template <class F>
+size_t
+pull_batch (op &upstream, std::vector <stack::uptr> &out, size_t max, F f)
+{
+  size_t begin = out.size ();
+  while (out.size () == begin)
+    {
+      std::exception_ptr exc;
+      try
+	{
+	  if (upstream.next_batch (out, max) == 0)
+	    return 0;
+	}
+      catch (...)
+	{
+	  exc = std::current_exception ();
+	}
+
+      size_t j = begin;
+      try
+	{
+	  for (size_t i = begin; i < out.size (); ++i)
+	    if (f (*out[i]))
+	      {
+		if (i != j)
+		  out[j] = std::move (out[i]);
+		++j;
+	      }
+	}
+      catch (...)
+	{
+	  out.erase (out.begin () + j, out.end ());
+	  throw;
+	}
+
+      out.erase (out.begin () + j, out.end ());
+      if (exc != nullptr)
+	std::rethrow_exception (exc);
+    }
+
+  return out.size () - begin;
+}
 
 struct value_producer
 {
@@ -80,6 +139,25 @@ struct value_producer_cat
   std::unique_ptr <value> next () override;
 };
 
+// A producer of a single value.
+struct value_producer_single
+  : public value_producer
+{
+  std::unique_ptr <value> m_value;
+
+  explicit value_producer_single (std::unique_ptr <value> value)
+    : m_value {std::move (value)}
+  {
+    assert (m_value != nullptr);
+  }
+
+  std::unique_ptr <value>
+  next () override
+  {
+    return std::move (m_value);
+  }
+};
+
 // An op that's not an origin has an upstream.
 class inner_op
   : public op
@@ -101,6 +179,8 @@ public:
 class pred
 {
 public:
+  virtual ~pred () {}
+
   virtual pred_result result (stack &stk) = 0;
   virtual std::string name () const = 0;
   virtual void reset () = 0;
@@ -185,6 +265,7 @@ public:
   {}
 
   stack::uptr next () override;
+  size_t next_batch (std::vector <stack::uptr> &out, size_t max) override;
   std::string name () const override;
 
   void reset () override
@@ -538,12 +619,12 @@ class op_lex_closure
   : public op
 {
   std::shared_ptr <op> m_upstream;
-  tree m_t;
+  std::shared_ptr <tree const> m_t;
 
 public:
   op_lex_closure (std::shared_ptr <op> upstream, tree t)
     : m_upstream {upstream}
-    , m_t {t}
+    , m_t {std::make_shared <tree> (t)}
   {}
 
   void reset () override;
@@ -653,6 +734,15 @@ public:
   void reset () override;
 };
 
+// Yields if PRED holds for any pair of results of OP1 and OP2.  OP2
+// is only evaluated once, its results are cached and reused for
+// further results of OP1.
+//
+// If PRED is known to be a plain ?eq, ?lt or ?gt, WANT should be the
+// cmp_result that it looks for.  The cached values are then put to a
+// hash table, or reduced to their maximum or minimum, and probed
+// instead of being tried one by one.  Otherwise WANT is
+// cmp_result::fail.
 class pred_subx_compare
   : public pred
 {
@@ -660,16 +750,19 @@ class pred_subx_compare
   std::shared_ptr <op> m_op2;
   std::shared_ptr <op_origin> m_origin;
   std::unique_ptr <pred> m_pred;
+  cmp_result m_want;
 
 public:
   pred_subx_compare (std::shared_ptr <op> op1,
 		     std::shared_ptr <op> op2,
 		     std::shared_ptr <op_origin> origin,
-		     std::unique_ptr <pred> pred)
+		     std::unique_ptr <pred> pred,
+		     cmp_result want = cmp_result::fail)
     : m_op1 {op1}
     , m_op2 {op2}
     , m_origin {origin}
     , m_pred {std::move (pred)}
+    , m_want {want}
   {}
 
   pred_result result (stack &stk) override;
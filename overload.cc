@@ -29,12 +29,12 @@
 #include <iostream>
 #include <memory>
 #include <algorithm>
+#include <sstream>
 
 #include "overload.hh"
 
 overload_instance::overload_instance
-	(std::vector <std::tuple <selector,
-				  std::shared_ptr <builtin>>> const &stencil)
+	(std::vector <overload_t> const &stencil)
 {
   for (auto const &v: stencil)
     {
@@ -125,17 +125,19 @@ overload_tab::overload_tab (overload_tab const &a, overload_tab const &b)
   : overload_tab {a}
 {
   for (auto const &overload: b.m_overloads)
-    add_overload (std::get <0> (overload), std::get <1> (overload));
+    add_overload (std::get <0> (overload), std::get <1> (overload),
+		  std::get <2> (overload));
 }
 
 void
-overload_tab::add_overload (selector sel, std::shared_ptr <builtin> b)
+overload_tab::add_overload (selector sel, std::shared_ptr <builtin> b,
+			    uint8_t result)
 {
   // Check someone didn't order overload for this type yet.
   for (auto const &ovl: m_overloads)
     assert (std::get <0> (ovl) != sel);
 
-  m_overloads.push_back (std::make_tuple (sel, b));
+  m_overloads.push_back (std::make_tuple (sel, b, result));
 }
 
 overload_instance
@@ -144,6 +146,24 @@ overload_tab::instantiate ()
   return overload_instance {m_overloads};
 }
 
+overload_t const *
+overload_tab::find_static (stack_shape const &shape) const
+{
+  // Dispatch picks the first matching overload.  Stop at the first
+  // one that can't be ruled out statically.
+  selector profile = shape.profile ();
+  for (auto const &ovl: m_overloads)
+    {
+      selector const &sel = std::get <0> (ovl);
+      if (! sel.decidable (profile))
+	return nullptr;
+      if (sel.matches (profile))
+	return &ovl;
+    }
+
+  return nullptr;
+}
+
 
 struct overload_op::pimpl
 {
@@ -269,6 +289,14 @@ overloaded_op_builtin::create_merged (std::shared_ptr <overload_tab> tab) const
   return std::make_shared <overloaded_op_builtin> (name (), tab);
 }
 
+std::shared_ptr <builtin const>
+overloaded_op_builtin::peg (stack_shape const &shape) const
+{
+  if (auto ovl = get_overload_tab ()->find_static (shape))
+    return std::make_shared <pegged_builtin> (name (), *ovl, false, true);
+  return nullptr;
+}
+
 namespace
 {
   struct named_overload_pred
@@ -310,5 +338,107 @@ overloaded_pred_builtin <Positive>::create_merged
   return std::make_shared <overloaded_pred_builtin> (name (), tab);
 }
 
+template <bool Positive>
+std::shared_ptr <builtin const>
+overloaded_pred_builtin <Positive>::peg (stack_shape const &shape) const
+{
+  if (auto ovl = get_overload_tab ()->find_static (shape))
+    return std::make_shared <pegged_builtin> (name (), *ovl, true, Positive);
+  return nullptr;
+}
+
 template class overloaded_pred_builtin <true>;
 template class overloaded_pred_builtin <false>;
+
+std::shared_ptr <op>
+pegged_builtin::build_exec (std::shared_ptr <op> upstream) const
+{
+  return std::get <1> (m_ovl)->build_exec (upstream);
+}
+
+std::unique_ptr <pred>
+pegged_builtin::build_pred () const
+{
+  auto pred = std::get <1> (m_ovl)->build_pred ();
+  if (pred == nullptr || m_positive)
+    return pred;
+  else
+    return std::make_unique <pred_not> (std::move (pred));
+}
+
+void
+pegged_builtin::update_shape (stack_shape &shape) const
+{
+  if (m_is_pred)
+    return;
+
+  // All op overloads take their operands off the stack and push one
+  // value in their place.
+  shape.pop (std::get <0> (m_ovl).size ());
+  shape.push (std::get <2> (m_ovl));
+}
+
+std::shared_ptr <builtin>
+pegged_builtin::reduce (std::string const &key, value const &val,
+			bool pos_used) const
+{
+  if (m_is_pred)
+    return nullptr;
+
+  auto reduced = std::get <1> (m_ovl)->reduce (key, val, pos_used);
+  if (reduced == nullptr)
+    return nullptr;
+
+  // Keys of the form "KEY PRED" come from filters ?(KEY VAL PRED),
+  // those that start with '@' from projections.  The latter change
+  // what's pushed, so the result type is not known anymore.
+  std::stringstream ss;
+  uint8_t result = std::get <2> (m_ovl);
+  auto sp = key.find (' ');
+  if (key[0] == '@')
+    {
+      ss << m_name << " " << key << " ";
+      val.show (ss, brevity::full);
+      result = 0;
+    }
+  else if (sp == std::string::npos)
+    {
+      ss << m_name << " (" << key << " == ";
+      val.show (ss, brevity::full);
+      ss << ")";
+    }
+  else
+    {
+      ss << m_name << " ?(" << key.substr (0, sp) << " ";
+      val.show (ss, brevity::full);
+      ss << key.substr (sp) << ")";
+    }
+
+  return std::make_shared <pegged_builtin>
+    (ss.str (), overload_t {std::get <0> (m_ovl), reduced, result},
+     false, true);
+}
+
+std::unique_ptr <value>
+pegged_builtin::as_filter (std::string &key) const
+{
+  if (! m_is_pred || ! m_positive)
+    return nullptr;
+
+  return std::get <1> (m_ovl)->as_filter (key);
+}
+
+std::unique_ptr <value>
+pegged_builtin::as_projection (std::string &key) const
+{
+  if (m_is_pred)
+    return nullptr;
+
+  return std::get <1> (m_ovl)->as_projection (key);
+}
+
+bool
+pegged_builtin::splits_by_unit () const
+{
+  return ! m_is_pred && std::get <1> (m_ovl)->splits_by_unit ();
+}
@@ -65,6 +65,17 @@
 // sub-classes of these templates.  See below for comments on these.
 //
 // For example of this in action, see e.g. operator length.
+//
+// Where the types of values that an overloaded builtin will see are
+// known statically, tree::peg_overloads replaces it with a
+// pegged_builtin, which builds the chosen overload directly and
+// bypasses the dispatch altogether.  Pegged builtins also give access
+// to reduction points of the overloads (see builtin::reduce), which
+// tree::reduce_strength uses.
+
+// Each overload is a selector, a builtin, and the type code of the
+// value that it pushes (0 if not known, or if it's a predicate).
+typedef std::tuple <selector, std::shared_ptr <builtin>, uint8_t> overload_t;
 
 class overload_instance
 {
@@ -74,9 +85,7 @@ class overload_instance
   std::vector <std::shared_ptr <pred>> m_preds;
 
 public:
-  overload_instance (std::vector
-			<std::tuple <selector,
-				     std::shared_ptr <builtin>>> const &stencil);
+  overload_instance (std::vector <overload_t> const &stencil);
 
   std::pair <std::shared_ptr <op_origin>, std::shared_ptr <op>>
     find_exec (stack &stk);
@@ -88,19 +97,24 @@ public:
 
 class overload_tab
 {
-  std::vector <std::tuple <selector, std::shared_ptr <builtin>>> m_overloads;
+  std::vector <overload_t> m_overloads;
 
 public:
   overload_tab () = default;
   overload_tab (overload_tab const &that) = default;
   overload_tab (overload_tab const &a, overload_tab const &b);
 
-  void add_overload (selector vt, std::shared_ptr <builtin> b);
+  void add_overload (selector vt, std::shared_ptr <builtin> b,
+		     uint8_t result = 0);
 
   template <class T, class... As> void add_op_overload (As &&... arg);
   template <class T, class... As> void add_pred_overload (As &&... arg);
 
   overload_instance instantiate ();
+
+  // Find the overload that a stack of SHAPE would be dispatched to.
+  // Returns nullptr if that can't be decided statically.
+  overload_t const *find_static (stack_shape const &shape) const;
 };
 
 class overload_op
@@ -158,6 +172,11 @@ public:
 
   virtual std::shared_ptr <overloaded_builtin>
   create_merged (std::shared_ptr <overload_tab> tab) const = 0;
+
+  // Return a builtin that builds directly the overload that a stack of
+  // SHAPE would be dispatched to, or nullptr if that's not known.
+  virtual std::shared_ptr <builtin const>
+  peg (stack_shape const &shape) const = 0;
 };
 
 // Base class for overloaded operation builtins.
@@ -171,6 +190,9 @@ struct overloaded_op_builtin
 
   std::shared_ptr <overloaded_builtin>
   create_merged (std::shared_ptr <overload_tab> tab) const override final;
+
+  std::shared_ptr <builtin const>
+  peg (stack_shape const &shape) const override final;
 };
 
 // Base class for overloaded predicate builtins.
@@ -184,8 +206,72 @@ struct overloaded_pred_builtin
 
   std::shared_ptr <overloaded_builtin>
   create_merged (std::shared_ptr <overload_tab> tab) const override final;
+
+  std::shared_ptr <builtin const>
+  peg (stack_shape const &shape) const override final;
+
+  void
+  update_shape (stack_shape &shape) const override final
+  {}
 };
 
+// An overloaded builtin resolved statically to one of its overloads.
+class pegged_builtin
+  : public builtin
+{
+  std::string m_name;
+  overload_t m_ovl;
+  bool m_is_pred;
+  bool m_positive;
+
+public:
+  pegged_builtin (std::string const &name, overload_t const &ovl,
+		  bool is_pred, bool positive)
+    : m_name {name}
+    , m_ovl {ovl}
+    , m_is_pred {is_pred}
+    , m_positive {positive}
+  {}
+
+  std::shared_ptr <op> build_exec (std::shared_ptr <op> upstream)
+    const override;
+  std::unique_ptr <pred> build_pred () const override;
+  void update_shape (stack_shape &shape) const override;
+
+  // The reduced builtin is pegged to the same overload, but builds
+  // whatever the overload's reduction point hands out.
+  std::shared_ptr <builtin>
+  reduce (std::string const &key, value const &val, bool pos_used)
+    const override;
+
+  // Only positive predicates are forwarded.
+  std::unique_ptr <value> as_filter (std::string &key) const override;
+
+  // Only ops are forwarded.
+  std::unique_ptr <value> as_projection (std::string &key) const override;
+  bool splits_by_unit () const override;
+
+  char const *name () const override { return m_name.c_str (); }
+};
+
+
+// Type code of the value that an op overload pushes.  Overloads for
+// which that's not known have value as their result_type.
+
+template <class T>
+uint8_t
+overload_result_code ()
+{
+  return T::vtype.code ();
+}
+
+template <>
+inline uint8_t
+overload_result_code <value> ()
+{
+  return 0;
+}
+
 
 // The following is for delayed dispatch of an op constructor with
 // arguments provided when adding an overload through add_op_overload.
@@ -201,38 +287,87 @@ struct overload_op_builder_impl
   {
     return std::make_shared <Op> (upstream, std::get <I> (args)...);
   }
+
+  template <size_t... I>
+  static std::shared_ptr <builtin>
+  reduce (std::string const &key, value const &val, bool pos_used,
+	  std::index_sequence <I...>,
+	  std::tuple <std::remove_reference_t <Args>...> const &args)
+  {
+    return Op::reduce (key, val, pos_used, std::get <I> (args)...);
+  }
+
+  template <size_t... I>
+  static std::unique_ptr <value>
+  as_projection (std::string &key, std::index_sequence <I...>,
+		 std::tuple <std::remove_reference_t <Args>...> const &args)
+  {
+    return Op::as_projection (key, std::get <I> (args)...);
+  }
 };
 
 template <class Op, class... Args>
-void
-overload_tab::add_op_overload (Args &&... args)
+struct overload_op_builtin
+  : public builtin
 {
-  struct overload_op_builtin
-    : public builtin
+  std::tuple <std::remove_reference_t <Args>...> m_args;
+
+  overload_op_builtin (Args &&... args2)
+    : m_args (std::forward <Args> (args2)...)
+  {}
+
+  std::shared_ptr <op>
+  build_exec (std::shared_ptr <op> upstream) const override final
   {
-    std::tuple <std::remove_reference_t <Args>...> m_args;
+    return overload_op_builder_impl <Op, Args...>::template build
+      (upstream, std::index_sequence_for <Args...> {}, m_args);
+  }
 
-    overload_op_builtin (Args &&... args2)
-      : m_args (std::forward <Args> (args2)...)
-    {}
+  char const *
+  name () const override final
+  {
+    return "overload";
+  }
 
-    std::shared_ptr <op>
-    build_exec (std::shared_ptr <op> upstream) const override final
-    {
-      return overload_op_builder_impl <Op, Args...>::template build
-	(upstream, std::index_sequence_for <Args...> {}, m_args);
-    }
+  std::shared_ptr <builtin>
+  reduce (std::string const &key, value const &val,
+	  bool pos_used) const override final
+  {
+    return overload_op_builder_impl <Op, Args...>::template reduce
+      (key, val, pos_used, std::index_sequence_for <Args...> {}, m_args);
+  }
 
-    char const *
-    name () const override final
-    {
-      return "overload";
-    }
-  };
+  std::unique_ptr <value>
+  as_projection (std::string &key) const override final
+  {
+    return overload_op_builder_impl <Op, Args...>::template as_projection
+      (key, std::index_sequence_for <Args...> {}, m_args);
+  }
+
+  bool
+  splits_by_unit () const override final
+  {
+    return Op::splits_by_unit ();
+  }
+};
+
+// Create a builtin that builds Op with arguments ARGS.  Reduction
+// points use this to hand out their reduced ops.
+template <class Op, class... Args>
+std::shared_ptr <builtin>
+make_overload_op_builtin (Args &&... args)
+{
+  return std::make_shared <overload_op_builtin <Op, Args...>>
+    (std::forward <Args> (args)...);
+}
 
+template <class Op, class... Args>
+void
+overload_tab::add_op_overload (Args &&... args)
+{
   add_overload (Op::get_selector (),
-		std::make_shared <overload_op_builtin>
-			(std::forward <Args> (args)...));
+		make_overload_op_builtin <Op> (std::forward <Args> (args)...),
+		overload_result_code <typename Op::result_type> ());
 }
 
 
@@ -250,6 +385,14 @@ struct overload_pred_builder_impl
   {
     return std::make_unique <Pred> (std::get <I> (args)...);
   }
+
+  template <size_t... I>
+  static std::unique_ptr <value>
+  as_filter (std::string &key, std::index_sequence <I...>,
+	     std::tuple <std::remove_reference_t <Args>...> const &args)
+  {
+    return Pred::as_filter (key, std::get <I> (args)...);
+  }
 };
 
 template <class Pred, class... Args>
@@ -277,6 +420,13 @@ overload_tab::add_pred_overload (Args &&... args)
     {
       return "overload";
     }
+
+    std::unique_ptr <value>
+    as_filter (std::string &key) const override final
+    {
+      return overload_pred_builder_impl <Pred, Args...>::template as_filter
+        (key, std::index_sequence_for <Args...> {}, m_args);
+    }
   };
 
   add_overload (Pred::get_selector (),
@@ -338,6 +488,41 @@ protected:
 public:
   static selector get_selector ()
   { return {VT::vtype...}; }
+
+  // Overloads that always push a value of the same type should
+  // redeclare this.  It's used for static resolution of overloads
+  // further down the pipeline.
+  typedef value result_type;
+
+  // Reduction point, see builtin::reduce.  Overloads that know a
+  // shortcut should redeclare this and hand out a builtin made by
+  // make_overload_op_builtin.  Ops that were themselves made that way
+  // get the arguments they were made with appended.
+  template <class... Args>
+  static std::shared_ptr <builtin>
+  reduce (std::string const &key, value const &val, bool pos_used,
+	  Args const &... args)
+  {
+    return nullptr;
+  }
+
+  // See builtin::as_projection.  Overloads that amount to a
+  // projection should redeclare this.  It's called with the arguments
+  // that the op was made with.
+  template <class... Args>
+  static std::unique_ptr <value>
+  as_projection (std::string &key, Args const &... args)
+  {
+    return nullptr;
+  }
+
+  // See builtin::splits_by_unit.  Overloads that walk units of a
+  // Dwarf through its unit range should redeclare this.
+  static bool
+  splits_by_unit ()
+  {
+    return false;
+  }
 };
 
 template <class... VT>
@@ -373,6 +558,20 @@ public:
     return nullptr;
   }
 
+  size_t
+  next_batch (std::vector <stack::uptr> &out, size_t max) override final
+  {
+    return pull_batch (*this->m_upstream, out, max, [this] (stack &stk) {
+	auto nv = call_operate
+	  (std::index_sequence_for <VT...> {},
+	   op_overload_impl <VT...>::template collect <0, VT...> (stk));
+	if (nv == nullptr)
+	  return false;
+	stk.push (std::move (nv));
+	return true;
+      });
+  }
+
   virtual std::unique_ptr <value> operate (std::unique_ptr <VT>... vals) = 0;
 };
 
@@ -392,6 +591,12 @@ class op_yielding_overload
   stack::uptr m_stk;
   std::unique_ptr <value_producer> m_prod;
 
+  // Input stacks for next_batch, and an exception that upstream threw
+  // after producing them.
+  std::vector <stack::uptr> m_pending;
+  size_t m_next;
+  std::exception_ptr m_error;
+
   void
   reset_me ()
   {
@@ -402,6 +607,7 @@ class op_yielding_overload
 public:
   op_yielding_overload (std::shared_ptr <op> upstream)
     : stub_op {upstream}
+    , m_next {0}
   {}
 
   stack::uptr
@@ -431,10 +637,68 @@ public:
       }
   }
 
+  size_t
+  next_batch (std::vector <stack::uptr> &out, size_t max) override final
+  {
+    size_t begin = out.size ();
+    while (out.size () - begin < max)
+      {
+	if (m_prod != nullptr)
+	  {
+	    if (auto v = m_prod->next ())
+	      {
+		auto ret = std::make_unique <stack> (*m_stk);
+		ret->push (std::move (v));
+		out.push_back (std::move (ret));
+		continue;
+	      }
+	    reset_me ();
+	  }
+
+	if (m_next == m_pending.size ())
+	  {
+	    // Results of stacks that upstream produced before failing
+	    // are handed out first.
+	    if (m_error != nullptr)
+	      {
+		if (out.size () > begin)
+		  break;
+		auto exc = m_error;
+		m_error = nullptr;
+		std::rethrow_exception (exc);
+	      }
+
+	    m_pending.clear ();
+	    m_next = 0;
+	    try
+	      {
+		if (this->m_upstream->next_batch (m_pending, max) == 0)
+		  break;
+	      }
+	    catch (...)
+	      {
+		m_error = std::current_exception ();
+	      }
+	    continue;
+	  }
+
+	auto stk = std::move (m_pending[m_next++]);
+	m_prod = call_operate
+	  (std::index_sequence_for <VT...> {},
+	   op_overload_impl <VT...>::template collect <0, VT...> (*stk));
+	m_stk = std::move (stk);
+      }
+
+    return out.size () - begin;
+  }
+
   void
   reset () override
   {
     reset_me ();
+    m_pending.clear ();
+    m_next = 0;
+    m_error = nullptr;
     stub_op::reset ();
   }
 
@@ -486,6 +750,16 @@ public:
 
   static selector get_selector ()
   { return {VT::vtype...}; }
+
+  // See builtin::as_filter.  Predicates that amount to an assertion
+  // (KEY == VAL) should redeclare this.  It's called with the
+  // arguments that were given to add_pred_overload.
+  template <class... Args>
+  static std::unique_ptr <value>
+  as_filter (std::string &key, Args const &... args)
+  {
+    return nullptr;
+  }
 };
 
 #endif /* _OVERLOAD_H_ */
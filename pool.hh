@@ -0,0 +1,137 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <cstddef>
+#include <new>
+
+// Classes whose instances are created and destroyed for every DIE or
+// every result (stacks, DIE values, ...) derive from pooled <T> to
+// get class-specific operator new and delete.  Those keep freed
+// blocks on a per-thread free list and hand them out again, so that
+// in steady state, evaluation doesn't need to go to malloc at all.
+//
+// Only blocks of exactly sizeof (T) are pooled, anything else (such
+// as a class that derives from T) is passed to the global operators.
+template <class T>
+class pooled
+{
+  struct block
+  {
+    block *next;
+  };
+
+  // This is a POD, and as such it's never destroyed and can be used
+  // even after the thread has started tearing down its thread-local
+  // objects.
+  struct free_list
+  {
+    block *head;
+    size_t size;
+    bool armed;
+    bool closed;
+  };
+
+  // Cap on the number of free blocks kept around.
+  static size_t const max_free = 4096;
+
+  static free_list &
+  get_free_list ()
+  {
+    static thread_local free_list fl;
+    return fl;
+  }
+
+  // Frees whatever is left on the free list when the thread exits,
+  // and makes later deallocations go directly to the global operator.
+  struct reaper
+  {
+    ~reaper ()
+    {
+      free_list &fl = get_free_list ();
+      while (fl.head != nullptr)
+	{
+	  block *b = fl.head;
+	  fl.head = b->next;
+	  ::operator delete (b);
+	}
+      fl.size = 0;
+      fl.closed = true;
+    }
+  };
+
+  static void
+  arm_reaper ()
+  {
+    static thread_local reaper r;
+    (void) r;
+  }
+
+public:
+  static void *
+  operator new (size_t size)
+  {
+    free_list &fl = get_free_list ();
+    if (size != sizeof (T) || fl.head == nullptr)
+      return ::operator new (size);
+
+    block *b = fl.head;
+    fl.head = b->next;
+    --fl.size;
+    return b;
+  }
+
+  static void
+  operator delete (void *ptr, size_t size)
+  {
+    static_assert (sizeof (T) >= sizeof (block),
+		   "pooled class too small to hold a free-list link");
+
+    free_list &fl = get_free_list ();
+    if (size != sizeof (T) || fl.closed || fl.size >= max_free)
+      {
+	::operator delete (ptr);
+	return;
+      }
+
+    if (! fl.armed)
+      {
+	fl.armed = true;
+	arm_reaper ();
+      }
+
+    block *b = static_cast <block *> (ptr);
+    b->next = fl.head;
+    fl.head = b;
+    ++fl.size;
+  }
+};
+
+#endif /* _POOL_H_ */
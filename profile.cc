@@ -0,0 +1,369 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "builtin.hh"
+#include "op.hh"
+#include "profile.hh"
+
+namespace
+{
+  bool profiling = false;
+
+  struct counters
+  {
+    uint64_t calls = 0;
+    uint64_t yields = 0;
+    uint64_t resets = 0;
+    std::chrono::nanoseconds total {0};
+    std::chrono::nanoseconds nested {0};
+
+    counters &
+    operator+= (counters const &other)
+    {
+      calls += other.calls;
+      yields += other.yields;
+      resets += other.resets;
+      total += other.total;
+      nested += other.nested;
+      return *this;
+    }
+  };
+}
+
+struct profile::node
+{
+  std::string m_name;
+
+  // Name of the builtin that the node was built for, if any.  Many
+  // ops that implement builtins don't have a name of their own.
+  std::string m_builtin;
+  std::vector <node *> m_children;
+
+  // Each op or pred built for this node has its own counters, so
+  // that ops that run in different threads don't share them.
+  std::vector <std::shared_ptr <counters>> m_counters;
+
+  void
+  set_name (std::string const &name)
+  {
+    m_name = name;
+    if (! m_builtin.empty () && m_name.find (m_builtin) == std::string::npos)
+      m_name += " (" + m_builtin + ")";
+  }
+};
+
+namespace
+{
+  struct registry
+  {
+    std::mutex m_lock;
+
+    // A node is identified by the tree that it was built for, whether
+    // it's a pred, and its parent.  The parent is included, because
+    // trees of closures may be freed, and their addresses reused.
+    std::map <std::tuple <tree const *, bool, profile::node *>,
+	      std::unique_ptr <profile::node>> m_nodes;
+    std::vector <profile::node *> m_roots;
+  };
+
+  registry &
+  get_registry ()
+  {
+    static registry reg;
+    return reg;
+  }
+
+  // Node of the innermost profile scope in this thread.
+  thread_local profile::node *current_scope = nullptr;
+
+  // Op or pred that is currently running in this thread, and node
+  // that it was built for.
+  thread_local counters *current_counters = nullptr;
+  thread_local profile::node *current_node = nullptr;
+
+  class timer
+  {
+    counters &m_counters;
+    counters *m_saved_counters;
+    profile::node *m_saved_node;
+    std::chrono::steady_clock::time_point m_start;
+
+  public:
+    timer (counters &c, profile::node *n)
+      : m_counters (c)
+      , m_saved_counters {current_counters}
+      , m_saved_node {current_node}
+      , m_start {std::chrono::steady_clock::now ()}
+    {
+      current_counters = &m_counters;
+      current_node = n;
+    }
+
+    ~timer ()
+    {
+      auto elapsed = std::chrono::steady_clock::now () - m_start;
+      m_counters.total += elapsed;
+      if (m_saved_counters != nullptr)
+	m_saved_counters->nested += elapsed;
+      current_counters = m_saved_counters;
+      current_node = m_saved_node;
+    }
+  };
+
+  class op_profile
+    : public op
+  {
+    std::shared_ptr <op> m_op;
+    std::shared_ptr <counters> m_counters;
+    profile::node *m_node;
+
+  public:
+    op_profile (std::shared_ptr <op> op, std::shared_ptr <counters> c,
+		profile::node *n)
+      : m_op {op}
+      , m_counters {c}
+      , m_node {n}
+    {}
+
+    stack::uptr
+    next () override
+    {
+      timer t {*m_counters, m_node};
+      ++m_counters->calls;
+      auto ret = m_op->next ();
+      if (ret != nullptr)
+	++m_counters->yields;
+      return ret;
+    }
+
+    size_t
+    next_batch (std::vector <stack::uptr> &out, size_t max) override
+    {
+      timer t {*m_counters, m_node};
+      ++m_counters->calls;
+      size_t begin = out.size ();
+      try
+	{
+	  size_t n = m_op->next_batch (out, max);
+	  m_counters->yields += n;
+	  return n;
+	}
+      catch (...)
+	{
+	  m_counters->yields += out.size () - begin;
+	  throw;
+	}
+    }
+
+    void
+    reset () override
+    {
+      timer t {*m_counters, m_node};
+      ++m_counters->resets;
+      m_op->reset ();
+    }
+
+    std::string
+    name () const override
+    {
+      return m_op->name ();
+    }
+  };
+
+  class pred_profile
+    : public pred
+  {
+    std::unique_ptr <pred> m_pred;
+    std::shared_ptr <counters> m_counters;
+    profile::node *m_node;
+
+  public:
+    pred_profile (std::unique_ptr <pred> pred, std::shared_ptr <counters> c,
+		  profile::node *n)
+      : m_pred {std::move (pred)}
+      , m_counters {c}
+      , m_node {n}
+    {}
+
+    pred_result
+    result (stack &stk) override
+    {
+      timer t {*m_counters, m_node};
+      ++m_counters->calls;
+      auto ret = m_pred->result (stk);
+      if (ret == pred_result::yes)
+	++m_counters->yields;
+      return ret;
+    }
+
+    void
+    reset () override
+    {
+      timer t {*m_counters, m_node};
+      ++m_counters->resets;
+      m_pred->reset ();
+    }
+
+    std::string
+    name () const override
+    {
+      return m_pred->name ();
+    }
+  };
+
+  double
+  millis (std::chrono::nanoseconds ns)
+  {
+    return std::chrono::duration <double, std::milli> (ns).count ();
+  }
+}
+
+void
+profile::enable ()
+{
+  profiling = true;
+}
+
+bool
+profile::enabled ()
+{
+  return profiling;
+}
+
+profile::scope::scope (tree const &t, bool is_pred)
+  : m_saved {current_scope}
+{
+  // Ops built at run time, such as bodies of closures, nest in the op
+  // that builds them.
+  node *parent = m_saved != nullptr ? m_saved : current_node;
+
+  auto &reg = get_registry ();
+  std::lock_guard <std::mutex> lock {reg.m_lock};
+  auto &n = reg.m_nodes[std::make_tuple (&t, is_pred, parent)];
+  if (n == nullptr)
+    {
+      n = std::make_unique <node> ();
+      if (t.tt () == tree_type::F_BUILTIN)
+	n->m_builtin = t.m_builtin->name ();
+      (parent != nullptr ? parent->m_children : reg.m_roots)
+	.push_back (n.get ());
+    }
+
+  m_node = n.get ();
+  current_scope = m_node;
+}
+
+profile::scope::~scope ()
+{
+  current_scope = m_saved;
+}
+
+std::shared_ptr <op>
+profile::scope::wrap (std::shared_ptr <op> op)
+{
+  auto c = std::make_shared <counters> ();
+  {
+    auto &reg = get_registry ();
+    std::lock_guard <std::mutex> lock {reg.m_lock};
+    m_node->m_counters.push_back (c);
+    if (m_node->m_name.empty ())
+      m_node->set_name (op->name ());
+  }
+  return std::make_shared <op_profile> (op, c, m_node);
+}
+
+std::unique_ptr <pred>
+profile::scope::wrap (std::unique_ptr <pred> pred)
+{
+  if (pred == nullptr)
+    return nullptr;
+
+  auto c = std::make_shared <counters> ();
+  {
+    auto &reg = get_registry ();
+    std::lock_guard <std::mutex> lock {reg.m_lock};
+    m_node->m_counters.push_back (c);
+    if (m_node->m_name.empty ())
+      m_node->set_name (pred->name ());
+  }
+  return std::make_unique <pred_profile> (std::move (pred), c, m_node);
+}
+
+namespace
+{
+  void
+  report_nodes (std::ostream &os, std::vector <profile::node *> const &nodes,
+		unsigned depth)
+  {
+    for (auto n: nodes)
+      {
+	// Nodes that nothing was built for (such as builtins that turned
+	// out not to be predicates) are not shown.
+	if (n->m_counters.empty ())
+	  {
+	    report_nodes (os, n->m_children, depth);
+	    continue;
+	  }
+
+	counters sum;
+	for (auto const &c: n->m_counters)
+	  sum += *c;
+
+	os << std::setw (10) << sum.calls << std::setw (10) << sum.yields
+	   << std::setw (8) << sum.resets
+	   << std::fixed << std::setprecision (3)
+	   << std::setw (12) << millis (sum.total)
+	   << std::setw (12) << millis (sum.total - sum.nested)
+	   << "  " << std::string (2 * depth, ' ') << n->m_name << '\n';
+
+	report_nodes (os, n->m_children, depth + 1);
+      }
+  }
+}
+
+void
+profile::report (std::ostream &os)
+{
+  auto &reg = get_registry ();
+  std::lock_guard <std::mutex> lock {reg.m_lock};
+
+  auto flags = os.flags ();
+  os << std::setw (10) << "calls" << std::setw (10) << "yields"
+     << std::setw (8) << "resets" << std::setw (12) << "total ms"
+     << std::setw (12) << "self ms" << "  op\n";
+  report_nodes (os, reg.m_roots, 0);
+  os.flags (flags);
+}
@@ -0,0 +1,79 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <iosfwd>
+#include <memory>
+
+struct tree;
+class op;
+class pred;
+
+// Execution profile of a query, as requested by --profile.  While
+// profiling is enabled, tree::build_exec and tree::build_pred wrap
+// every op and pred that they build in one that counts calls,
+// produced stacks and resets, and measures time spent in the call.
+// Counters are kept per tree node and summed over all ops built for
+// that node, in all threads.  When profiling is not enabled, nothing
+// is wrapped and execution is not affected.
+class profile
+{
+public:
+  struct node;
+
+  // Enable profiling.  This has to be done before anything is built.
+  static void enable ();
+  static bool enabled ();
+
+  // Write the profile collected so far to OS.  The ops are listed in
+  // the order in which they were built, indented to show how they
+  // nest, with the times in milliseconds.  Total time includes time
+  // spent in upstream and nested ops, self time doesn't.  This
+  // should only be called when no query is being run.
+  static void report (std::ostream &os);
+
+  // While a scope is alive, ops and preds built in this thread are
+  // recorded as nested in the node that the scope describes.
+  class scope
+  {
+    node *m_node;
+    node *m_saved;
+
+  public:
+    scope (tree const &t, bool is_pred);
+    ~scope ();
+
+    // Wrap an op or a pred built for the scope's node.
+    std::shared_ptr <op> wrap (std::shared_ptr <op> op);
+    std::unique_ptr <pred> wrap (std::unique_ptr <pred> pred);
+  };
+};
+
+#endif /* _PROFILE_H_ */
@@ -84,6 +84,11 @@ private:
     return sel >> ((W - N) * 8);
   }
 
+  selector (sel_t imprint, sel_t mask)
+    : m_imprint {imprint & mask}
+    , m_mask {mask}
+  {}
+
 public:
   template <class... Ts, std::enable_if_t <(sizeof... (Ts) <= W), int> Fake = 0>
   selector (Ts... vts)
@@ -98,12 +103,38 @@ public:
     , m_mask (that.m_mask)
   {}
 
+  // A profile of a stack of which only some slots are known
+  // statically.  KNOWN has 0xff in bytes corresponding to those.
+  static selector
+  partial_profile (sel_t imprint, sel_t known)
+  {
+    return {imprint, known};
+  }
+
   bool
   matches (selector const &profile) const
   {
     return (profile.m_imprint & m_mask) == m_imprint;
   }
 
+  // Whether matching against a partial PROFILE can be decided, i.e.
+  // whether this selector only looks at slots that are known.
+  bool
+  decidable (selector const &profile) const
+  {
+    return (m_mask & ~profile.m_mask) == 0;
+  }
+
+  // Number of stack slots that this selector looks at.
+  size_t
+  size () const
+  {
+    size_t ret = 0;
+    for (sel_t mask = m_mask; mask != 0; mask >>= 8)
+      ++ret;
+    return ret;
+  }
+
   bool operator< (selector const &that) const
   { return m_imprint < that.m_imprint; }
   bool operator== (selector const &that) const
@@ -0,0 +1,118 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _SHAPE_H_
+#define _SHAPE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "selector.hh"
+
+// What is known at build time about types of values near TOS.  This
+// is used for resolving overloaded words ahead of time (see
+// tree::peg_overloads).
+class stack_shape
+{
+  // Type codes of the topmost slots, the last one is TOS.  0 stands
+  // for a slot whose type is not known.  Nothing is known about the
+  // slots deeper than this reaches.
+  std::vector <uint8_t> m_codes;
+
+public:
+  void
+  clear ()
+  {
+    m_codes.clear ();
+  }
+
+  void
+  push (uint8_t code)
+  {
+    m_codes.push_back (code);
+  }
+
+  void
+  pop (size_t n = 1)
+  {
+    m_codes.erase (m_codes.end () - std::min (n, m_codes.size ()),
+		   m_codes.end ());
+  }
+
+  // Type code of the value DEPTH slots below TOS, or 0 if unknown.
+  uint8_t
+  get (size_t depth) const
+  {
+    if (depth >= m_codes.size ())
+      return 0;
+    return *(m_codes.rbegin () + depth);
+  }
+
+  // Forget whatever THAT disagrees on.  This is used where control
+  // flow merges.
+  void
+  meet (stack_shape const &that)
+  {
+    size_t n = std::min (m_codes.size (), that.m_codes.size ());
+    std::vector <uint8_t> codes (n);
+    for (size_t i = 0; i < n; ++i)
+      if (get (i) == that.get (i))
+	codes[n - 1 - i] = get (i);
+    m_codes = std::move (codes);
+  }
+
+  bool
+  operator== (stack_shape const &that) const
+  {
+    return m_codes == that.m_codes;
+  }
+
+  bool
+  operator!= (stack_shape const &that) const
+  {
+    return m_codes != that.m_codes;
+  }
+
+  // Stack profile (see class stack) as far as it's known.
+  selector
+  profile () const
+  {
+    selector::sel_t imprint = 0;
+    selector::sel_t known = 0;
+    for (size_t i = 0; i < selector::W; ++i)
+      if (uint8_t code = get (i))
+	{
+	  imprint |= ((selector::sel_t) code) << (8 * i);
+	  known |= ((selector::sel_t) 0xff) << (8 * i);
+	}
+    return selector::partial_profile (imprint, known);
+  }
+};
+
+#endif /* _SHAPE_H_ */
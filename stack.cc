@@ -34,85 +34,99 @@ frame::bind_value (var_id index, std::unique_ptr <value> val)
   assert (index < m_values.size ());
   // XXX this might actually be an assertion.  Cases of this should be
   // statically determinable.
-  if (m_values[index] != nullptr)
+  if (m_values[index])
     throw std::runtime_error ("attempt to rebind a bound variable");
 
-  m_values[index] = std::move (val);
+  m_values[index] = shared_value {std::move (val)};
 }
 
-value &
-frame::read_value (var_id index)
+shared_value const &
+frame::read_value (var_id index) const
 {
   assert (index < m_values.size ());
   // XXX this might actually be an assertion.  Cases of this should be
   // statically determinable.
-  if (m_values[index] == nullptr)
+  if (! m_values[index])
     throw std::runtime_error ("attempt to read an unbound variable");
 
-  return *m_values[index];
+  return m_values[index];
 }
 
 std::shared_ptr <frame>
 frame::clone () const
 {
-  auto ret = std::make_shared <frame> (m_parent, 0);
-  for (auto const &val: m_values)
-    ret->m_values.push_back (val != nullptr ? val->clone () : nullptr);
-  return ret;
+  return std::make_shared <frame> (*this);
 }
 
 stack::stack (stack const &that)
-  : m_frame {that.m_frame != nullptr ? that.m_frame->clone () : nullptr}
+  : m_frame {that.m_frame}
   , m_profile {that.m_profile}
+  , m_frame_shared {true}
 {
-  for (auto const &v: that.m_values)
-    m_values.push_back (v->clone ());
+  that.m_frame_shared = true;
+
+  // Copies are mostly made to push a value on top of them.  Leave
+  // room for it, so that the push doesn't need to reallocate.
+  m_values.reserve (that.m_values.size () + 1);
+  m_values.insert (m_values.end (), that.m_values.begin (),
+		   that.m_values.end ());
+}
+
+void
+stack::bind_value (size_t depth, var_id index, std::unique_ptr <value> val)
+{
+  // Only the top frame is private to a stack.  Frames further up are
+  // shared with whatever else was made in their scope.
+  if (depth == 0 && m_frame_shared)
+    {
+      m_frame = m_frame->clone ();
+      m_frame_shared = false;
+    }
+
+  nth_frame (depth)->bind_value (index, std::move (val));
+}
+
+std::shared_ptr <frame>
+stack::capture_frame ()
+{
+  if (m_frame != nullptr && m_frame_shared)
+    {
+      m_frame = m_frame->clone ();
+      m_frame_shared = false;
+    }
+
+  return m_frame;
 }
 
 namespace
 {
   int
-  compare_stack (std::vector <std::unique_ptr <value> > const &a,
-	       std::vector <std::unique_ptr <value> > const &b)
+  compare_stack (std::vector <shared_value> const &a,
+		 std::vector <shared_value> const &b)
   {
     if (a.size () < b.size ())
       return -1;
     else if (a.size () > b.size ())
       return 1;
 
-    // The stack that has nullptr where the other has non-nullptr is
-    // smaller.
+    // The stack with "smaller" types is smaller.
     {
       auto it = a.begin ();
       auto jt = b.begin ();
       for (; it != a.end (); ++it, ++jt)
-	if (*it == nullptr && *jt != nullptr)
+	if ((*it)->get_type () < (*jt)->get_type ())
 	  return -1;
-	else if (*it != nullptr && *jt == nullptr)
+	else if ((*jt)->get_type () < (*it)->get_type ())
 	  return 1;
     }
 
-    // The stack with "smaller" types is smaller.
-    {
-      auto it = a.begin ();
-      auto jt = b.begin ();
-      for (; it != a.end (); ++it, ++jt)
-	if (*it != nullptr && *jt != nullptr)
-	  {
-	    if ((*it)->get_type () < (*jt)->get_type ())
-	      return -1;
-	    else if ((*jt)->get_type () < (*it)->get_type ())
-	      return 1;
-	  }
-    }
-
     // We have the same number of slots with values of the same type.
     // Now compare the values directly.
     {
       auto it = a.begin ();
       auto jt = b.begin ();
       for (; it != a.end (); ++it, ++jt)
-	if (*it != nullptr && *jt != nullptr)
+	if (&**it != &**jt)
 	  switch ((*it)->cmp (**jt))
 	    {
 	    case cmp_result::fail:
@@ -143,3 +157,12 @@ stack::operator== (stack const &that) const
 {
   return compare_stack (m_values, that.m_values) == 0;
 }
+
+size_t
+stack::hash () const
+{
+  size_t h = m_values.size ();
+  for (auto const &v: m_values)
+    h = hash_combine (hash_combine (h, v->get_type ().code ()), v->hash ());
+  return h;
+}
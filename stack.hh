@@ -34,40 +34,135 @@
 
 #include "value.hh"
 #include "selector.hh"
+#include "pool.hh"
 
 enum var_id: unsigned {};
 
+// A handle to a value that may be shared by several stacks.  Copying
+// a stack only copies the handles, a value is cloned only when one of
+// the stacks that share it pops it.  Shared values must therefore not
+// be modified in place.  The reference count is not atomic, values
+// are never shared across threads.
+class shared_value
+{
+  value *m_val;
+
+public:
+  // An empty handle, which refers to no value.
+  shared_value ()
+    : m_val {nullptr}
+  {}
+
+  explicit shared_value (std::unique_ptr <value> val)
+    : m_val {val.release ()}
+  {
+    assert (m_val != nullptr);
+    assert (m_val->m_refs == 0);
+    m_val->m_refs = 1;
+  }
+
+  shared_value (shared_value const &that)
+    : m_val {that.m_val}
+  {
+    if (m_val != nullptr)
+      ++m_val->m_refs;
+  }
+
+  shared_value (shared_value &&that) noexcept
+    : m_val {that.m_val}
+  {
+    that.m_val = nullptr;
+  }
+
+  ~shared_value ()
+  {
+    if (m_val != nullptr && --m_val->m_refs == 0)
+      delete m_val;
+  }
+
+  shared_value &
+  operator= (shared_value that)
+  {
+    std::swap (m_val, that.m_val);
+    return *this;
+  }
+
+  value &
+  operator* () const
+  {
+    return *m_val;
+  }
+
+  value *
+  operator-> () const
+  {
+    return m_val;
+  }
+
+  explicit operator bool () const
+  {
+    return m_val != nullptr;
+  }
+
+  // Give up this handle.  If it was the only one, the value itself is
+  // handed over, otherwise the caller gets a clone.
+  std::unique_ptr <value>
+  release ()
+  {
+    value *val = m_val;
+    m_val = nullptr;
+
+    if (val->m_refs == 1)
+      {
+	val->m_refs = 0;
+	return std::unique_ptr <value> {val};
+      }
+
+    --val->m_refs;
+    return val->clone ();
+  }
+};
+
 // Stack frame, or activation record, of a running procedure (or other
-// sort of context).
+// sort of context).  Values bound in a frame are shared handles, so
+// that a frame can be copied cheaply.
 struct frame
 {
   std::shared_ptr <frame> m_parent;
-  std::vector <std::unique_ptr <value>> m_values;
+  std::vector <shared_value> m_values;
 
   frame (std::shared_ptr <frame> parent, size_t vars)
     : m_parent {parent}
-    , m_values {vars}
+    , m_values (vars)
   {}
 
   void bind_value (var_id index, std::unique_ptr <value> val);
-  value &read_value (var_id index);
+  shared_value const &read_value (var_id index) const;
 
+  // A frame with the same parent, bound to the same values.
   std::shared_ptr <frame> clone () const;
 };
 
 // Value file is a container type that's used for maintaining stacks
 // of dwgrep values.
 class stack
+  : public pooled <stack>
 {
-  std::vector <std::unique_ptr <value>> m_values;
+  std::vector <shared_value> m_values;
   std::shared_ptr <frame> m_frame;
   selector::sel_t m_profile;
 
+  // Whether M_FRAME may be referenced by other stacks.  Copies of a
+  // stack share its frame, and the frame is only copied when one of
+  // them binds a variable in it.
+  mutable bool m_frame_shared;
+
 public:
   typedef std::unique_ptr <stack> uptr;
 
   stack ()
     : m_profile {0}
+    , m_frame_shared {false}
   {}
 
   stack (stack const &other);
@@ -87,8 +182,27 @@ public:
   set_frame (std::shared_ptr <frame> frame)
   {
     m_frame = frame;
+    m_frame_shared = true;
+  }
+
+  // Make a new frame with VARS unbound variables the current one.  Its
+  // parent is the frame that was current so far.
+  void
+  push_frame (size_t vars)
+  {
+    m_frame = std::make_shared <frame> (m_frame, vars);
+    m_frame_shared = false;
   }
 
+  // Bind VAL to variable INDEX of the frame DEPTH levels up.
+  void bind_value (size_t depth, var_id index, std::unique_ptr <value> val);
+
+  // The current frame, for a closure to keep.  Variables bound later
+  // in this stack, such as the closure's own name, must show up in
+  // that frame, so if it's shared, the stack first takes a private
+  // copy and hands out that.
+  std::shared_ptr <frame> capture_frame ();
+
   size_t
   size () const
   {
@@ -103,6 +217,12 @@ public:
 
   void
   push (std::unique_ptr <value> vp)
+  {
+    push (shared_value {std::move (vp)});
+  }
+
+  void
+  push (shared_value vp)
   {
     m_profile <<= 8;
     m_profile |= vp->get_type ().code ();
@@ -113,7 +233,7 @@ public:
   pop ()
   {
     assert (! m_values.empty ());
-    auto ret = std::move (m_values.back ());
+    auto ret = m_values.back ().release ();
     m_values.pop_back ();
     m_profile >>= 8;
     if (m_values.size () >= selector::W)
@@ -137,21 +257,21 @@ public:
   top ()
   {
     assert (! m_values.empty ());
-    return *m_values.back ().get ();
+    return *m_values.back ();
   }
 
   value &
   get (unsigned depth)
   {
     assert (m_values.size () > depth);
-    return *(m_values.rbegin () + depth)->get ();
+    return **(m_values.rbegin () + depth);
   }
 
   value const &
   get (unsigned depth) const
   {
     assert (m_values.size () > depth);
-    return *(m_values.rbegin () + depth)->get ();
+    return **(m_values.rbegin () + depth);
   }
 
   template <class T>
@@ -172,6 +292,10 @@ public:
 
   bool operator< (stack const &that) const;
   bool operator== (stack const &that) const;
+
+  // Hash of the slot values, consistent with operator==.  Like the
+  // comparison operators, this ignores the frame.
+  size_t hash () const;
 };
 
 #endif /* _STK_H_ */
@@ -302,6 +302,10 @@ do_tests ()
 	 " (F_BUILTIN<elem>) (STR<>)))",
 	 true);
 
+  ftest ("?(1 == 2)",
+	 "(ASSERT (PRED_SUBX_CMP (CONST<1>) (CONST<2>) (F_BUILTIN<?eq>)))",
+	 true);
+
   test ("((1, 2), (3, 4))",
 	"(ALT (CONST<1>) (CONST<2>) (CONST<3>) (CONST<4>))");
 
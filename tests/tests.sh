@@ -17,6 +17,20 @@ expect_count ()
     fi
 }
 
+expect_output ()
+{
+    export total=$((total + 1))
+    EXPECTED=$1
+    shift
+    GOT=$(timeout 10 ../dwgrep "$@" 2>/dev/null)
+    if [ "$GOT" != "$EXPECTED" ]; then
+	echo "FAIL: dwgrep" "$@"
+	echo "expected: $EXPECTED"
+	echo "     got: $GOT"
+	export failures=$((failures + 1))
+    fi
+}
+
 expect_count 1 ./empty -e '1   10 ?lt'
 expect_count 1 ./empty -e '10  10 !lt'
 expect_count 1 ./empty -e '100 10 !lt'
@@ -175,6 +189,10 @@ expect_count 7 ./duplicate-const -e '
 expect_count 7 ./duplicate-const -e '
 	entry (@AT_decl_file !~ ".*pavel.*")'
 
+# Compiled patterns are cached, which must not mix them up.
+expect_count 10 ./twocus -e '
+	entry @AT_name (|N| (N, "^[fm]") (|P| N =~ P))'
+
 # Test true/false
 expect_count 1 ./typedef.o -e '
 	entry ?(@AT_external == true)'
@@ -327,6 +345,21 @@ expect_count 1 ./empty -e '
 	?(7 fact 5040 ?eq)
 	?(8 fact 40320 ?eq)'
 
+# A recursive closure bound in a stack that was copied must still see
+# its own name.
+expect_output "$(printf '%s\n' 120 120)" ./empty -e '
+	(1, 2) drop {|N| (?(N 2 ?lt) 1 || N 1 sub fact N mul)} -> fact;
+	5 fact swap drop'
+
+# Compiled closures are reused across applications.  Each call must
+# still see its own arguments.
+expect_count 1 ./twocus -e '
+	{|D| ?(D ?root) 0, ?(D !root) D parent depth 1 add} -> depth;
+	[entry depth] ?([0, 1, 1, 0, 1, 2, 3, 1] ?eq)'
+expect_count 1 ./empty -e '
+	let adder := {|X| {|Y| X Y add}};
+	[(1, 2) adder (10, 20) swap apply] ?([11, 21, 22, 12] ?eq)'
+
 # Examples.
 expect_count 1 ./duplicate-const -e '
 	let ?cvr_type := {?TAG_const_type,?TAG_volatile_type,?TAG_restrict_type};
@@ -537,6 +570,14 @@ expect_count 1 ./empty -e '
 	overlap: (0x15 0x55 aset)
 	== 0x15 0x20 aset add: (0x30 0x40 aset) add: (0x50 0x55 aset)'
 
+expect_count 1 ./empty -e '
+	10 20 aset 12 14 aset overlap == 12 14 aset'
+expect_count 1 ./empty -e '
+	0x10 0x20 aset add: (0x30 0x40 aset) add: (0x50 0x60 aset)
+	?(0x12 0x14 aset add: (0x52 0x54 aset) ?contains)
+	?(0x12 0x14 aset add: (0x22 0x24 aset) !contains)
+	sub: (0x18 0x58 aset) == 0x10 0x18 aset add: (0x58 0x60 aset)'
+
 expect_count 1 ./empty -e '
 	(10 20 aset length == 10)
 	(10 10 aset length == 0)'
@@ -562,6 +603,40 @@ expect_count 1 ./aranges.o -e '
 	     0x1000e, 0x1000f, 0x10010, 0x10011, 0x10012, 0x10013, 0x10014]
 	    relem]'
 
+expect_count 1 ./aranges.o -e '
+	entry ?TAG_lexical_block parent ?TAG_subprogram !root
+	parent ?root ?TAG_compile_unit'
+expect_count 2 ./aranges.o -e 'entry ?TAG_subprogram child parent ?TAG_subprogram'
+
+expect_count 3 ./aranges.o -e 'entry ?(address 0x10010 ?contains)'
+expect_count 2 ./aranges.o -e 'entry ?(address 0x1000a ?contains)'
+expect_count 1 ./aranges.o -e '
+	entry ?TAG_lexical_block ?(address 0x10014 ?contains) (offset == 0x5b)'
+expect_count 0 ./aranges.o -e '
+	entry ?TAG_lexical_block ?(address 0x10015 ?contains)'
+expect_count 1 ./aranges.o -e '
+	[(0x10004, 0x1000a, 0x10010, 0x10020) (|A| A entry offset)]
+	== [0xb, 0x2d, 0x5b, 0xb, 0x2d, 0xb, 0x2d, 0x5b]'
+expect_count 1 ./aranges.o -e 'unit 0x10010 entry ?TAG_lexical_block'
+
+# DIEs found by address are numbered like results of other ops.
+expect_count 1 ./aranges.o -e '[(|D| D 0x10010 entry pos)] == [0, 1, 2]'
+expect_count 1 ./aranges.o -e '[unit (|C| C 0x10010 entry pos)] == [0, 1, 2]'
+expect_count 1 ./aranges.o -e '
+	[(|D| D 0x10010 entry ?TAG_lexical_block pos)] == [2]'
+
+expect_count 1 ./aranges.o -e '
+	[entry ?AT_low_pc pos] == [entry ?(?AT_low_pc) pos]'
+expect_count 1 ./duplicate-const -e '
+	[unit entry ?AT_name ?TAG_variable offset]
+	== [unit entry ?(?TAG_variable) ?(?AT_name) offset]'
+
+expect_count 1 ./typedef.o -e '
+	[entry ?TAG_typedef @AT_name] == [entry ?(?TAG_typedef) @AT_name]'
+expect_count 1 ./aranges.o -e '
+	[unit entry ?AT_low_pc @AT_name pos]
+	== [unit entry ?(?AT_low_pc) @AT_name pos]'
+
 expect_count 1 ./pointer_const_value.o -e '
 	entry @AT_const_value == 0'
 
@@ -621,5 +696,97 @@ expect_count 1 ./duplicate-const -e '[entry label] == [entry abbrev label]'
 expect_count 1 ./twocus -e '[abbrev offset] == [0, 0x34]'
 expect_count 1 ./twocus -e '?(abbrev entry (|A| A pos 1 add == A code))'
 
+# Parallel processing of several files must keep the output in
+# command-line order.
+expect_count "$(printf '%s\n' 2 1 2 1)" -h -j 3 \
+    ./twocus ./typedef.o ./twocus ./empty -e 'entry ?root'
+
+# A single file is split across threads by units.
+expect_count 2 -j 4 ./twocus -e 'entry ?root'
+expect_count 2 -j 4 ./twocus -e 'unit'
+expect_count 1 -j 4 ./twocus -e 'unit (pos == 1)'
+
+# Reduced forms of entry and unit are split the same way.  --verbose
+# reports the number of jobs last.
+for Q in 'entry ?TAG_compile_unit' 'entry ?AT_name' 'entry @AT_name' \
+	 'entry ?TAG_subprogram ?AT_name' 'unit (offset == 0)'; do
+    total=$((total + 1))
+    GOT=$(timeout 10 ../dwgrep --verbose -c -j 4 ./twocus -e "$Q" 2>&1 >/dev/null \
+	      | tail -n 1)
+    if [ "$GOT" != "2 jobs" ]; then
+	echo "FAIL: dwgrep --verbose -c -j 4 ./twocus -e '$Q'"
+	echo "expected: 2 jobs"
+	echo "     got: $GOT"
+	failures=$((failures + 1))
+    fi
+done
+
+# Transitive closure stops at values that it has already seen.
+expect_count 3 ./empty -e '0 (1 add 3 mod)*'
+expect_count 3 ./empty -e '[0] ([elem 1 add 3 mod] swap drop)*'
+expect_count 3 ./empty -e '"a" (?("aaa" !=) "a" add)*'
+
+# Comparisons of two subexpressions.
+expect_count 5 ./nontrivial-types.o -e '
+	(|D| D entry ?(@AT_name == (D entry ?root child @AT_name)))'
+expect_count 3 ./nontrivial-types.o -e '
+	(|D| D entry ?(@AT_byte_size < (D entry @AT_byte_size)))'
+expect_count 3 ./empty -e '(1,2,3) ?((1,2,3) == (3, "x", 2))'
+
+# Shuffles must keep statically resolved overloads in sync with the
+# actual stack.
+expect_count 1 ./empty -e '"a" 1 swap "b" add ?("ab" ==)'
+expect_count 1 ./empty -e '1 "a" 2 rot add ?(3 ==)'
+expect_count 1 ./empty -e '1 "a" over 2 add ?(3 ==)'
+expect_count 1 ./empty -e '(1, "a") 2 add'
+
+# Filters that pin an offset, a label or a position are turned into
+# direct lookups.  These need to find the same things as the filters.
+expect_count 1 ./twocus -e 'entry (offset == 0xb) ?root'
+expect_count 1 ./twocus -e 'entry ?(0x2d == offset) ?(offset == 0x2d)'
+expect_count 0 ./twocus -e 'entry (offset == 0xc)'
+expect_count 1 ./twocus -e 'unit (offset == 0) entry (offset == 0xb)'
+expect_count 2 ./twocus -e 'entry ?root child (pos == 1) ?(pos == 1)'
+expect_count 7 ./twocus -e 'entry attribute (label == DW_AT_name)'
+expect_count 1 ./empty -e '[1, 2, 3] elem (pos == 1) ?(2 ==)'
+expect_count 1 ./empty -e '[1, 2, 3] relem (pos == 0) ?(3 ==)'
+expect_count 0 ./empty -e '[1, 2, 3] elem (pos == 3)'
+
+# Tag filters right after entry are pushed into the enumeration.
+# Positions must still count the DIEs that were skipped.
+expect_count 3 ./twocus -e 'entry ?TAG_subprogram'
+expect_count 3 ./twocus -e 'entry (label == DW_TAG_subprogram)'
+expect_count 1 ./twocus -e 'entry ?TAG_base_type ?(pos == 7)'
+expect_count 1 ./twocus -e 'unit entry ?TAG_base_type ?(pos == 4)'
+expect_count 1 ./twocus -e 'entry ?TAG_subprogram (offset == 0xa3)'
+
+# Results are computed in batches.  Those that precede an error must
+# still come out.
+expect_count 5 ./twocus -e 'entry (offset, ?(offset == 0x80) {} integrate)'
+
+# Stacks share frames until they bind a variable.
+expect_count 2 ./empty -e 'let X := 1, 2; let Y := X; ?(X == Y)'
+expect_count 1 ./twocus -e 'let A := entry (offset == 0x2d); let B := A, A child; ?(A == B)'
+
+# Profiling must not change results.
+expect_count 3 --profile ./twocus -e 'entry ?TAG_subprogram'
+expect_count 1 --profile ./twocus -e 'let f := {|X| X ?TAG_subprogram}; entry f (offset == 0xa3)'
+
+# Machine-readable output.
+expect_output '{"file":"./twocus","values":[{"type":"T_DIE","offset":128,"tag":{"value":46,"domain":"DW_TAG_*","text":"DW_TAG_subprogram"}}]}' \
+    --format=jsonl ./twocus -e 'entry (offset == 0x80)'
+expect_output '{"file":"./empty","values":[{"type":"T_STR","value":"a\"b"},{"type":"T_CONST","value":{"value":-1,"domain":"dec","text":"-1"}}]}' \
+    --format=jsonl ./empty -e 'drop -1 "a\"b"'
+
+# DIE index must give the same answers as walking the DIE tree.
+IDX=$(mktemp -d)
+../dwgrep --make-index --index-dir=$IDX ./twocus
+expect_count 8 --index-dir=$IDX ./twocus -e 'entry'
+expect_count 2 --index-dir=$IDX ./twocus -e 'entry ?root'
+expect_count 6 --index-dir=$IDX ./twocus -e 'entry parent'
+expect_count 1 --index-dir=$IDX ./twocus -e 'entry (offset == 0x2d) parent ?root'
+expect_count 1 --index-dir=$IDX ./twocus -e 'entry ?TAG_base_type ?(pos == 7)'
+rm -rf $IDX
+
 echo "$total tests total, $failures failures."
 [ $failures -eq 0 ]
@@ -302,6 +302,15 @@ tree::simplify ()
       simplify ();
     }
 
+  // Change (PRED_SUBX_ANY (ASSERT X)) to X.  The assertion passes
+  // the stack through at most once, so ?(?X) is the same as ?X.
+  if (m_tt == tree_type::PRED_SUBX_ANY
+      && child (0).m_tt == tree_type::ASSERT)
+    {
+      *this = child (0).child (0);
+      simplify ();
+    }
+
   // Change (FORMAT (STR)) to (STR).
   if (m_tt == tree_type::FORMAT
       && m_children.size () == 1
@@ -198,6 +198,26 @@ public:
   // Produce program suitable for interpretation.
   std::unique_ptr <pred> build_pred () const;
 
+  // The above, except that the result is not wrapped for profiling.
+  std::shared_ptr <op> do_build_exec (std::shared_ptr <op> upstream) const;
+  std::unique_ptr <pred> do_build_pred () const;
+
+  // Trace types of values on stack through the program, starting with
+  // a stack of SHAPE, and update SHAPE to describe the stack that the
+  // program leaves behind.  Overloaded builtins that are found to
+  // always see the same types are replaced by the overload that they
+  // would dispatch to.  If PEG is false, only SHAPE is computed.
+  void peg_overloads (stack_shape &shape, bool peg = true);
+
+  // Replace builtins that are followed by an assertion (KEY == VAL),
+  // such as (entry (offset == 0x123)), by what their reduction points
+  // offer instead (see builtin::reduce).  This should be done after
+  // peg_overloads, which is what gives access to most of these.
+  void reduce_strength ();
+
+  // Whether this tree refers to a builtin called NAME anywhere.
+  bool mentions_builtin (char const *name) const;
+
   // === Parser interface ===
   //
   // The following methods are implemented in tree_cr.hh and
@@ -38,25 +38,33 @@ class scope;
 class value_closure
   : public value
 {
-  std::unique_ptr <tree> m_t;
+  // Trees are immutable and shared by all closures made from the same
+  // lexical closure.  Ops compiled from the tree can thus be cached
+  // under its address.
+  std::shared_ptr <tree const> m_t;
   std::shared_ptr <frame> m_frame;
 
 public:
   static value_type const vtype;
 
-  value_closure (tree const &t, std::shared_ptr <frame> frame, size_t pos);
+  value_closure (std::shared_ptr <tree const> t,
+		 std::shared_ptr <frame> frame, size_t pos);
   value_closure (value_closure const &that);
   ~value_closure();
 
   tree const &get_tree () const
   { return *m_t; }
 
+  std::shared_ptr <tree const> get_tree_ptr () const
+  { return m_t; }
+
   std::shared_ptr <frame> get_frame () const
   { return m_frame; }
 
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 #endif /* _VALUE_CLOSURE_H_ */
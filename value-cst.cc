@@ -27,6 +27,7 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <iostream>
+#include <functional>
 #include <memory>
 
 #include "value-cst.hh"
@@ -69,6 +70,49 @@ value_cst::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_cst::hash () const
+{
+  // Equal numbers have the same bit pattern regardless of
+  // signedness, so that can be hashed directly.
+  size_t h = std::hash <uint64_t> {} (m_cst.value ().m_u);
+
+  // Constants from arithmetic domains compare equal across domains,
+  // so the domain only goes into the hash when it's not arithmetic.
+  if (! m_cst.dom ()->safe_arith ())
+    h = hash_combine (h, std::hash <constant_dom const *> {} (m_cst.dom ()));
+  return h;
+}
+
+void
+value_cst::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("value");
+  w.cst (m_cst);
+  w.end ();
+}
+
+bool
+pinned_constant (value const &val, constant_dom const &dom, uint64_t &ret)
+{
+  auto v = value::as <value_cst> (&val);
+  if (v == nullptr)
+    return false;
+
+  // Mirror value_cst::cmp.
+  constant const &cst = v->get_constant ();
+  if (cst.dom () != &dom
+      && (! cst.dom ()->safe_arith () || ! dom.safe_arith ()))
+    return false;
+
+  if (cst.value () < 0)
+    return false;
+
+  ret = cst.value ().uval ();
+  return true;
+}
+
 std::unique_ptr <value>
 op_value_cst::operate (std::unique_ptr <value_cst> a)
 {
@@ -32,9 +32,11 @@
 #include "value.hh"
 #include "op.hh"
 #include "overload.hh"
+#include "pool.hh"
 
 class value_cst
   : public value
+  , public pooled <value_cst>
 {
   constant m_cst;
 
@@ -54,11 +56,20 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
+// If VAL is a constant that compares equal to a constant of domain
+// DOM just when that has a certain non-negative value, store the
+// value to RET and return true.
+bool pinned_constant (value const &val, constant_dom const &dom,
+		      uint64_t &ret);
+
 struct op_value_cst
   : public op_overload <value_cst>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_cst> a) override;
@@ -70,6 +81,7 @@ struct op_value_cst
 struct op_add_cst
   : public op_overload <value_cst, value_cst>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_cst> a,
@@ -79,6 +91,7 @@ struct op_add_cst
 struct op_sub_cst
   : public op_overload <value_cst, value_cst>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_cst> a,
@@ -88,6 +101,7 @@ struct op_sub_cst
 struct op_mul_cst
   : public op_overload <value_cst, value_cst>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_cst> a,
@@ -97,6 +111,7 @@ struct op_mul_cst
 struct op_div_cst
   : public op_overload <value_cst, value_cst>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_cst> a,
@@ -106,6 +121,7 @@ struct op_div_cst
 struct op_mod_cst
   : public op_overload <value_cst, value_cst>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_cst> a,
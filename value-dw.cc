@@ -31,9 +31,12 @@
 #include <fcntl.h>
 
 #include <iostream>
+#include <functional>
 #include <memory>
 #include <system_error>
 #include <cerrno>
+#include <cinttypes>
+#include <cstdio>
 
 #include "atval.hh"
 #include "dwcst.hh"
@@ -79,7 +82,9 @@ namespace
 value_dwarf::value_dwarf (std::string const &fn, size_t pos)
   : value {vtype, pos}
   , m_fn {fn}
-  , m_dwctx {std::make_shared <dwfl_context> (open_dwfl (fn))}
+  , m_dwctx {new dwfl_context (open_dwfl (fn), fn)}
+  , m_unit_begin {0}
+  , m_unit_end {(size_t) -1}
 {}
 
 void
@@ -103,6 +108,12 @@ value_dwarf::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_dwarf::hash () const
+{
+  return std::hash <Dwfl *> {} (m_dwctx->get_dwfl ());
+}
+
 
 value_type const value_cu::vtype = value_type::alloc ("T_CU");
 
@@ -128,25 +139,50 @@ value_cu::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_cu::hash () const
+{
+  return std::hash <Dwarf_CU const *> {} (&m_cu);
+}
+
+void
+value_cu::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("offset");
+  w.uint (m_offset);
+  w.end ();
+}
+
 
 value_type const value_die::vtype = value_type::alloc ("T_DIE");
 
 void
 value_die::show (std::ostream &o, brevity brv) const
 {
-  ios_flag_saver fs {o};
-
   Dwarf_Die *die = const_cast <Dwarf_Die *> (&m_die);
-  o << '[' << std::hex << dwarf_dieoffset (die) << ']'
-    << (brv == brevity::full ? '\t' : ' ')
-    << constant (dwarf_tag (die), &dw_tag_dom, brevity::brief);
+
+  // This is shown for every DIE that a query produces, so format the
+  // offset by hand instead of toggling stream flags.
+  char buf[32];
+  int len = snprintf (buf, sizeof buf, "[%" PRIx64 "]%c",
+		      (uint64_t) dwarf_dieoffset (die),
+		      brv == brevity::full ? '\t' : ' ');
+  o.write (buf, len);
+  o << constant (dwarf_tag (die), &dw_tag_dom, brevity::brief);
 
   if (brv == brevity::full)
-    for (auto it = attr_iterator {die}; it != attr_iterator::end (); ++it)
-      {
-	o << "\n\t";
-	value_attr {m_dwctx, **it, m_die, 0}.show (o, brevity::full);
-      }
+    {
+      // Attribute values that don't set their own base come out in
+      // hex.
+      ios_flag_saver fs {o};
+      o << std::hex;
+      for (auto &at: die_attributes {die})
+	{
+	  o << "\n\t";
+	  value_attr {m_dwctx, at, m_die, 0}.show (o, brevity::full);
+	}
+    }
 }
 
 std::unique_ptr <value>
@@ -165,6 +201,24 @@ value_die::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_die::hash () const
+{
+  return std::hash <Dwarf_Off> {} (dwarf_dieoffset ((Dwarf_Die *) &m_die));
+}
+
+void
+value_die::describe (value_writer &w) const
+{
+  Dwarf_Die *die = const_cast <Dwarf_Die *> (&m_die);
+  w.begin (get_type ());
+  w.field ("offset");
+  w.uint (dwarf_dieoffset (die));
+  w.field ("tag");
+  w.cst (constant (dwarf_tag (die), &dw_tag_dom));
+  w.end ();
+}
+
 
 value_type const value_attr::vtype = value_type::alloc ("T_ATTR");
 
@@ -212,6 +266,33 @@ value_attr::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_attr::hash () const
+{
+  return hash_combine (dwarf_dieoffset ((Dwarf_Die *) &m_die),
+		       dwarf_whatattr ((Dwarf_Attribute *) &m_attr));
+}
+
+void
+value_attr::describe (value_writer &w) const
+{
+  Dwarf_Attribute *attr = const_cast <Dwarf_Attribute *> (&m_attr);
+  w.begin (get_type ());
+  w.field ("die");
+  w.uint (dwarf_dieoffset (const_cast <Dwarf_Die *> (&m_die)));
+  w.field ("name");
+  w.cst (constant (dwarf_whatattr (attr), &dw_attr_dom));
+  w.field ("form");
+  w.cst (constant (dwarf_whatform (attr), &dw_form_dom));
+  w.field ("value");
+  w.begin_list ();
+  auto vpr = at_value (m_dwctx, m_die, m_attr);
+  while (auto v = vpr->next ())
+    v->describe (w);
+  w.end_list ();
+  w.end ();
+}
+
 
 value_type const value_abbrev_unit::vtype
 	= value_type::alloc ("T_ABBREV_UNIT");
@@ -244,6 +325,12 @@ value_abbrev_unit::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_abbrev_unit::hash () const
+{
+  return std::hash <Dwarf_CU const *> {} (&m_cu);
+}
+
 
 value_type const value_abbrev::vtype
 	= value_type::alloc ("T_ABBREV");
@@ -293,6 +380,12 @@ value_abbrev::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_abbrev::hash () const
+{
+  return std::hash <Dwarf_Abbrev const *> {} (&m_abbrev);
+}
+
 
 value_type const value_abbrev_attr::vtype
 	= value_type::alloc ("T_ABBREV_ATTR");
@@ -320,12 +413,31 @@ value_abbrev_attr::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_abbrev_attr::hash () const
+{
+  return std::hash <Dwarf_Off> {} (offset);
+}
+
+void
+value_abbrev_attr::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("offset");
+  w.uint (offset);
+  w.field ("name");
+  w.cst (constant (name, &dw_attr_dom));
+  w.field ("form");
+  w.cst (constant (form, &dw_form_dom));
+  w.end ();
+}
+
 
 namespace
 {
   void
   show_loclist_op (std::ostream &o, brevity brv,
-		   std::shared_ptr <dwfl_context> dwctx,
+		   dwctx_ptr dwctx,
 		   Dwarf_Attribute const &attr, Dwarf_Op *dwop)
   {
     o << dwop->offset << ':'
@@ -418,6 +530,32 @@ value_loclist_elem::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_loclist_elem::hash () const
+{
+  size_t h = hash_combine (std::hash <void *> {} (m_attr.valp), m_low);
+  h = hash_combine (hash_combine (h, m_high), m_exprlen);
+  for (size_t i = 0; i < m_exprlen; ++i)
+    h = hash_combine (hash_combine (h, m_expr[i].atom), m_expr[i].number);
+  return h;
+}
+
+void
+value_loclist_elem::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("low");
+  w.uint (m_low);
+  w.field ("high");
+  w.uint (m_high);
+  w.field ("ops");
+  w.begin_list ();
+  for (size_t i = 0; i < m_exprlen; ++i)
+    value_loclist_op {m_dwctx, m_attr, m_expr + i, 0}.describe (w);
+  w.end_list ();
+  w.end ();
+}
+
 
 value_type const value_aset::vtype = value_type::alloc ("T_ASET");
 
@@ -458,6 +596,32 @@ value_aset::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_aset::hash () const
+{
+  size_t h = cov.size ();
+  for (size_t i = 0; i < cov.size (); ++i)
+    h = hash_combine (hash_combine (h, cov.at (i).start), cov.at (i).length);
+  return h;
+}
+
+void
+value_aset::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("ranges");
+  w.begin_list ();
+  for (size_t i = 0; i < cov.size (); ++i)
+    {
+      w.begin_list ();
+      w.uint (cov.at (i).start);
+      w.uint (cov.at (i).end ());
+      w.end_list ();
+    }
+  w.end_list ();
+  w.end ();
+}
+
 
 value_type const value_loclist_op::vtype = value_type::alloc ("T_LOCLIST_OP");
 
@@ -487,3 +651,33 @@ value_loclist_op::cmp (value const &that) const
   else
     return cmp_result::fail;
 }
+
+size_t
+value_loclist_op::hash () const
+{
+  return hash_combine (std::hash <void *> {} (m_attr.valp), m_dwop->offset);
+}
+
+void
+value_loclist_op::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("offset");
+  w.uint (m_dwop->offset);
+  w.field ("atom");
+  w.cst (constant (m_dwop->atom, &dw_locexpr_opcode_dom));
+  w.field ("operands");
+  w.begin_list ();
+  {
+    auto prod = dwop_number (m_dwctx, m_attr, m_dwop);
+    while (auto v = prod->next ())
+      v->describe (w);
+  }
+  {
+    auto prod = dwop_number2 (m_dwctx, m_attr, m_dwop);
+    while (auto v = prod->next ())
+      v->describe (w);
+  }
+  w.end_list ();
+  w.end ();
+}
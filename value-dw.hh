@@ -32,13 +32,19 @@
 #include <elfutils/libdwfl.h>
 #include "value.hh"
 #include "dwfl_context.hh"
+#include "pool.hh"
 #include "coverage.hh"
 
 class value_dwarf
   : public value
 {
   std::string m_fn;
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
+
+  // Units (numbered across all modules) that entry and unit should
+  // enumerate.  All of them unless restricted with restrict_units.
+  size_t m_unit_begin;
+  size_t m_unit_end;
 
 public:
   static value_type const vtype;
@@ -49,35 +55,50 @@ public:
   std::string &get_fn ()
   { return m_fn; }
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
+  // Make entry and unit only enumerate units [BEGIN, END).  This is
+  // used for splitting a query over a single file across threads.
+  void restrict_units (size_t begin, size_t end)
+  {
+    m_unit_begin = begin;
+    m_unit_end = end;
+  }
+
+  size_t get_unit_begin () const
+  { return m_unit_begin; }
+
+  size_t get_unit_end () const
+  { return m_unit_end; }
+
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 class value_cu
   : public value
 {
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
   Dwarf_Off m_offset;
   Dwarf_CU &m_cu;
 
 public:
   static value_type const vtype;
 
-  value_cu (std::shared_ptr <dwfl_context> dwctx, Dwarf_CU &cu,
+  value_cu (dwctx_ptr dwctx, Dwarf_CU &cu,
 	    Dwarf_Off offset, size_t pos)
     : value {vtype, pos}
-    , m_dwctx {dwctx}
+    , m_dwctx {std::move (dwctx)}
     , m_offset {offset}
     , m_cu {cu}
   {}
 
   value_cu (value_cu const &that) = default;
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
   Dwarf_CU &get_cu ()
@@ -89,21 +110,34 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 class value_die
   : public value
+  , public pooled <value_die>
 {
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
   Dwarf_Die m_die;
+  Dwarf_Off m_parent;
 
 public:
   static value_type const vtype;
 
-  value_die (std::shared_ptr <dwfl_context> dwctx, Dwarf_Die die, size_t pos)
+  // Values for PARENT below, besides the parent offset itself.
+  static Dwarf_Off const no_parent = (Dwarf_Off) -1;
+  static Dwarf_Off const unknown_parent = (Dwarf_Off) -2;
+
+  // Whoever makes a value for a DIE may already know the offset of
+  // its parent, or that it has none.  PARENT is that offset,
+  // no_parent for unit DIEs, or unknown_parent.
+  value_die (dwctx_ptr dwctx, Dwarf_Die die, size_t pos,
+	     Dwarf_Off parent = unknown_parent)
     : value {vtype, pos}
-    , m_dwctx {(assert (dwctx != nullptr), dwctx)}
+    , m_dwctx {(assert (dwctx != nullptr), std::move (dwctx))}
     , m_die (die)
+    , m_parent {parent}
   {}
 
   value_die (value_die const &that) = default;
@@ -111,35 +145,41 @@ public:
   Dwarf_Die &get_die ()
   { return m_die; }
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  Dwarf_Off get_parent () const
+  { return m_parent; }
+
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 class value_attr
   : public value
+  , public pooled <value_attr>
 {
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
   Dwarf_Die m_die;
   Dwarf_Attribute m_attr;
 
 public:
   static value_type const vtype;
 
-  value_attr (std::shared_ptr <dwfl_context> dwctx,
+  value_attr (dwctx_ptr dwctx,
 	      Dwarf_Attribute attr, Dwarf_Die die, size_t pos)
     : value {vtype, pos}
-    , m_dwctx {dwctx}
+    , m_dwctx {std::move (dwctx)}
     , m_die (die)
     , m_attr (attr)
   {}
 
   value_attr (value_attr const &that) = default;
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
   Dwarf_Die &get_die ()
@@ -151,27 +191,29 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 class value_abbrev_unit
   : public value
 {
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
   Dwarf_CU &m_cu;
 
 public:
   static value_type const vtype;
 
-  value_abbrev_unit (std::shared_ptr <dwfl_context> dwctx,
+  value_abbrev_unit (dwctx_ptr dwctx,
 		     Dwarf_CU &cu, size_t pos)
     : value {vtype, pos}
-    , m_dwctx {dwctx}
+    , m_dwctx {std::move (dwctx)}
     , m_cu {cu}
   {}
 
   value_abbrev_unit (value_abbrev_unit const &that) = default;
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
   Dwarf_CU &get_cu ()
@@ -180,27 +222,28 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 class value_abbrev
   : public value
 {
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
   Dwarf_Abbrev &m_abbrev;
 
 public:
   static value_type const vtype;
 
-  value_abbrev (std::shared_ptr <dwfl_context> dwctx,
+  value_abbrev (dwctx_ptr dwctx,
 		Dwarf_Abbrev &abbrev, size_t pos)
     : value {vtype, pos}
-    , m_dwctx {dwctx}
+    , m_dwctx {std::move (dwctx)}
     , m_abbrev {abbrev}
   {}
 
   value_abbrev (value_abbrev const &that) = default;
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
   Dwarf_Abbrev &get_abbrev ()
@@ -209,6 +252,7 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 struct value_abbrev_attr
@@ -233,12 +277,14 @@ struct value_abbrev_attr
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 class value_loclist_elem
   : public value
 {
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
   Dwarf_Attribute m_attr;
   Dwarf_Addr m_low;
   Dwarf_Addr m_high;
@@ -248,11 +294,11 @@ class value_loclist_elem
 public:
   static value_type const vtype;
 
-  value_loclist_elem (std::shared_ptr <dwfl_context> dwctx, Dwarf_Attribute attr,
+  value_loclist_elem (dwctx_ptr dwctx, Dwarf_Attribute attr,
 		      Dwarf_Addr low, Dwarf_Addr high,
 		      Dwarf_Op *expr, size_t exprlen, size_t pos)
     : value {vtype, pos}
-    , m_dwctx {dwctx}
+    , m_dwctx {std::move (dwctx)}
     , m_attr (attr)
     , m_low {low}
     , m_high {high}
@@ -262,7 +308,7 @@ public:
 
   value_loclist_elem (value_loclist_elem const &that) = default;
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
   Dwarf_Attribute &get_attr ()
@@ -283,6 +329,8 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 // Set of addresses.
@@ -306,6 +354,8 @@ struct value_aset
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 class value_loclist_op
@@ -314,24 +364,24 @@ class value_loclist_op
   // This apparently wild pointer points into libdw-private data.  We
   // actually need to carry a pointer, as some functions require that
   // they be called with the original pointer, not our own copy.
-  std::shared_ptr <dwfl_context> m_dwctx;
+  dwctx_ptr m_dwctx;
   Dwarf_Attribute m_attr;
   Dwarf_Op *m_dwop;
 
 public:
   static value_type const vtype;
 
-  value_loclist_op (std::shared_ptr <dwfl_context> dwctx, Dwarf_Attribute attr,
+  value_loclist_op (dwctx_ptr dwctx, Dwarf_Attribute attr,
 		    Dwarf_Op *dwop, size_t pos)
     : value {vtype, pos}
-    , m_dwctx {dwctx}
+    , m_dwctx {std::move (dwctx)}
     , m_attr (attr)
     , m_dwop (dwop)
   {}
 
   value_loclist_op (value_loclist_op const &that) = default;
 
-  std::shared_ptr <dwfl_context> get_dwctx ()
+  dwctx_ptr get_dwctx ()
   { return m_dwctx; }
 
   Dwarf_Attribute &get_attr ()
@@ -343,6 +393,8 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 #endif /* _VALUE_DW_H_ */
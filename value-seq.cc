@@ -33,6 +33,7 @@
 #include "value-seq.hh"
 #include "overload.hh"
 #include "value-cst.hh"
+#include "builtin-cst.hh"
 
 value_type const value_seq::vtype = value_type::alloc ("T_SEQ");
 
@@ -130,6 +131,27 @@ value_seq::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_seq::hash () const
+{
+  size_t h = m_seq->size ();
+  for (auto const &v: *m_seq)
+    h = hash_combine (hash_combine (h, v->get_type ().code ()), v->hash ());
+  return h;
+}
+
+void
+value_seq::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("elements");
+  w.begin_list ();
+  for (auto const &v: *m_seq)
+    v->describe (w);
+  w.end_list ();
+  w.end ();
+}
+
 std::unique_ptr <value>
 op_add_seq::operate (std::unique_ptr <value_seq> a,
 		     std::unique_ptr <value_seq> b)
@@ -215,6 +237,45 @@ op_relem_seq::operate (std::unique_ptr <value_seq> a)
   return std::make_unique <seq_relem_producer> (a->get_seq ());
 }
 
+namespace
+{
+  std::shared_ptr <builtin>
+  reduce_elem_seq (std::string const &key, value const &val, bool forward)
+  {
+    uint64_t pos;
+    if (key == "pos" && pinned_constant (val, pos_dom, pos))
+      return make_overload_op_builtin <op_elem_pos_seq> (pos, forward);
+    return nullptr;
+  }
+}
+
+std::shared_ptr <builtin>
+op_elem_seq::reduce (std::string const &key, value const &val,
+		     bool pos_used)
+{
+  return reduce_elem_seq (key, val, true);
+}
+
+std::shared_ptr <builtin>
+op_relem_seq::reduce (std::string const &key, value const &val,
+		      bool pos_used)
+{
+  return reduce_elem_seq (key, val, false);
+}
+
+std::unique_ptr <value_producer>
+op_elem_pos_seq::operate (std::unique_ptr <value_seq> a)
+{
+  auto seq = a->get_seq ();
+  if (m_pos >= seq->size ())
+    return nullptr;
+
+  size_t idx = m_forward ? m_pos : seq->size () - 1 - m_pos;
+  std::unique_ptr <value> v = (*seq)[idx]->clone ();
+  v->set_pos (m_pos);
+  return std::make_unique <value_producer_single> (std::move (v));
+}
+
 pred_result
 pred_empty_seq::result (value_seq &a)
 {
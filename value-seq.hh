@@ -30,6 +30,7 @@
 #define _VALUE_SEQ_H_
 
 #include "value.hh"
+#include "value-cst.hh"
 #include "op.hh"
 #include "overload.hh"
 
@@ -66,11 +67,14 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 struct op_add_seq
   : public op_overload <value_seq, value_seq>
 {
+  typedef value_seq result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_seq> a,
@@ -80,6 +84,7 @@ struct op_add_seq
 struct op_length_seq
   : public op_overload <value_seq>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_seq> a) override;
@@ -92,6 +97,9 @@ struct op_elem_seq
 
   std::unique_ptr <value_producer>
   operate (std::unique_ptr <value_seq> a) override;
+
+  static std::shared_ptr <builtin>
+  reduce (std::string const &key, value const &val, bool pos_used);
 };
 
 struct op_relem_seq
@@ -101,6 +109,26 @@ struct op_relem_seq
 
   std::unique_ptr <value_producer>
   operate (std::unique_ptr <value_seq> a) override;
+
+  static std::shared_ptr <builtin>
+  reduce (std::string const &key, value const &val, bool pos_used);
+};
+
+// elem (pos == N) and relem (pos == N).
+struct op_elem_pos_seq
+  : public op_yielding_overload <value_seq>
+{
+  size_t m_pos;
+  bool m_forward;
+
+  op_elem_pos_seq (std::shared_ptr <op> upstream, size_t pos, bool forward)
+    : op_yielding_overload {upstream}
+    , m_pos {pos}
+    , m_forward {forward}
+  {}
+
+  std::unique_ptr <value_producer>
+  operate (std::unique_ptr <value_seq> a) override;
 };
 
 struct pred_empty_seq
@@ -27,7 +27,9 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <iostream>
+#include <functional>
 #include <memory>
+#include <unordered_map>
 #include <regex.h>
 
 #include "value-str.hh"
@@ -57,6 +59,21 @@ value_str::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_str::hash () const
+{
+  return std::hash <std::string> {} (m_str);
+}
+
+void
+value_str::describe (value_writer &w) const
+{
+  w.begin (get_type ());
+  w.field ("value");
+  w.str (m_str);
+  w.end ();
+}
+
 std::unique_ptr <value>
 op_add_str::operate (std::unique_ptr <value_str> a,
 		     std::unique_ptr <value_str> b)
@@ -151,19 +168,75 @@ pred_find_str::result (value_str &haystack, value_str &needle)
 		      != std::string::npos);
 }
 
+namespace
+{
+  // The pattern is compiled in place, regex_t can't be copied.
+  struct compiled_regex
+  {
+    regex_t m_re;
+    bool m_valid;
+
+    explicit compiled_regex (std::string const &pattern)
+      : m_valid {regcomp (&m_re, pattern.c_str (),
+			  REG_EXTENDED | REG_NOSUB) == 0}
+    {}
+
+    compiled_regex (compiled_regex const &) = delete;
+    compiled_regex &operator= (compiled_regex const &) = delete;
+
+    ~compiled_regex ()
+    {
+      if (m_valid)
+	regfree (&m_re);
+    }
+  };
+}
+
+// Patterns are most often constant, so a pattern is compiled once and
+// then reused.  Patterns computed at run time could be all different,
+// so the cache is dropped when it grows too big.
+struct pred_match_str::regex_cache
+{
+  static size_t const max_size = 64;
+  std::unordered_map <std::string, std::unique_ptr <compiled_regex>> m_res;
+
+  regex_t const *
+  find (std::string const &pattern)
+  {
+    auto it = m_res.find (pattern);
+    if (it != m_res.end ())
+      return &it->second->m_re;
+
+    auto cre = std::make_unique <compiled_regex> (pattern);
+    if (! cre->m_valid)
+      return nullptr;
+
+    if (m_res.size () >= max_size)
+      m_res.clear ();
+
+    return &m_res.emplace (pattern, std::move (cre)).first->second->m_re;
+  }
+};
+
+pred_match_str::pred_match_str ()
+  : m_cache {std::make_unique <regex_cache> ()}
+{}
+
+pred_match_str::~pred_match_str ()
+{}
+
 pred_result
 pred_match_str::result (value_str &haystack, value_str &needle)
 {
-  regex_t re;
-  if (regcomp (&re, needle.get_string ().c_str(),
-	       REG_EXTENDED | REG_NOSUB) != 0)
+  regex_t const *re = m_cache->find (needle.get_string ());
+  if (re == nullptr)
     {
       std::cerr << "Error: could not compile regular expression: '"
 		<< needle.get_string () << "'\n";
       return pred_result::fail;
     }
 
-  const int reti = regexec (&re, haystack.get_string ().c_str (),
+  const int reti = regexec (re, haystack.get_string ().c_str (),
 			    /* nmatch: size of pmatch array */ 0,
 			    /* pmatch: array of matches */ NULL,
 			    /* no extra flags */ 0);
@@ -176,10 +249,9 @@ pred_match_str::result (value_str &haystack, value_str &needle)
   else
     {
       char msgbuf[100];
-      regerror (reti, &re, msgbuf, sizeof (msgbuf));
+      regerror (reti, re, msgbuf, sizeof (msgbuf));
       std::cerr << "Error: match failed: " << msgbuf << "\n";
     }
 
-  regfree (&re);
   return retval;
 }
@@ -31,6 +31,7 @@
 
 #include <string>
 #include "value.hh"
+#include "value-cst.hh"
 #include "op.hh"
 #include "overload.hh"
 
@@ -53,11 +54,14 @@ public:
   void show (std::ostream &o, brevity brv) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  void describe (value_writer &w) const override;
 };
 
 struct op_add_str
   : public op_overload <value_str, value_str>
 {
+  typedef value_str result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_str> a,
@@ -67,6 +71,7 @@ struct op_add_str
 struct op_length_str
   : public op_overload <value_str>
 {
+  typedef value_cst result_type;
   using op_overload::op_overload;
 
   std::unique_ptr <value> operate (std::unique_ptr <value_str> a) override;
@@ -107,7 +112,13 @@ struct pred_find_str
 struct pred_match_str
   : public pred_overload <value_str, value_str>
 {
-  using pred_overload::pred_overload;
+  // Compiled regular expressions, looked up by pattern.
+  struct regex_cache;
+  std::unique_ptr <regex_cache> m_cache;
+
+  pred_match_str ();
+  ~pred_match_str ();
+
   pred_result result (value_str &haystack, value_str &needle) override;
 };
 
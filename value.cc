@@ -29,6 +29,7 @@
 #include <iostream>
 #include <memory>
 #include <algorithm>
+#include <sstream>
 
 #include "op.hh"
 #include "tree.hh"
@@ -130,6 +131,18 @@ value::get_type_const () const
   return {get_type ().code (), &slot_type_dom};
 }
 
+void
+value::describe (value_writer &w) const
+{
+  std::ostringstream os;
+  show (os, brevity::full);
+
+  w.begin (get_type ());
+  w.field ("text");
+  w.str (os.str ());
+  w.end ();
+}
+
 std::ostream &
 operator<< (std::ostream &o, value const &v)
 {
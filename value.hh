@@ -30,6 +30,7 @@
 #define _VALUE_H_
 
 #include <memory>
+#include <string>
 
 #include "constant.hh"
 #include "dwgrep.hh"
@@ -53,6 +54,13 @@ compare (T const &a, T const &b)
   return cmp_result::equal;
 }
 
+// Mix hash H into SEED.  Meant for composing value::hash results.
+inline size_t
+hash_combine (size_t seed, size_t h)
+{
+  return seed ^ (h + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
 // We use this to keep track of types of instances of subclasses of
 // class value.  value::as uses this to avoid having to dynamic_cast,
 // which is needlessly flexible and slow for our purposes.
@@ -108,18 +116,51 @@ std::ostream &operator<< (std::ostream &o, value_type const &v);
 // A domain for slot type constants.
 extern constant_dom const &slot_type_dom;
 
+// Receiver of a structured description of a value, see
+// value::describe.  A value is described as a sequence of named
+// fields enclosed in begin and end calls.  Each field holds a single
+// item: a number, a string, a constant, a nested value, or a list of
+// items enclosed in begin_list and end_list calls.
+class value_writer
+{
+public:
+  virtual ~value_writer () {}
+
+  virtual void begin (value_type type) = 0;
+  virtual void field (char const *name) = 0;
+  virtual void end () = 0;
+
+  virtual void begin_list () = 0;
+  virtual void end_list () = 0;
+
+  virtual void uint (uint64_t v) = 0;
+  virtual void str (std::string const &s) = 0;
+  virtual void cst (constant const &c) = 0;
+};
+
 class value
 {
+  friend class shared_value;
+
   value_type const m_type;
   size_t m_pos;
 
+  // Number of shared_value handles referring to this value.
+  unsigned m_refs;
+
 protected:
   value (value_type t, size_t pos)
     : m_type {t}
     , m_pos {pos}
+    , m_refs {0}
   {}
 
-  value (value const &that) = default;
+  // A copy is a new value, nobody refers to it yet.
+  value (value const &that)
+    : m_type {that.m_type}
+    , m_pos {that.m_pos}
+    , m_refs {0}
+  {}
 
 public:
   value_type get_type () const { return m_type; }
@@ -130,6 +171,15 @@ public:
   virtual std::unique_ptr <value> clone () const = 0;
   virtual cmp_result cmp (value const &that) const = 0;
 
+  // Values for which cmp answers cmp_result::equal need to hash to
+  // the same number.
+  virtual size_t hash () const = 0;
+
+  // Describe this value to W, for machine-readable output.  The
+  // default describes it as a field "text" with what show would
+  // print.
+  virtual void describe (value_writer &w) const;
+
   void
   set_pos (size_t pos)
   {
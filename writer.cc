@@ -0,0 +1,342 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "value.hh"
+#include "writer.hh"
+
+namespace
+{
+  std::string
+  constant_text (constant const &c)
+  {
+    if (c.dom () == nullptr)
+      return "";
+
+    std::ostringstream os;
+    os << c;
+    return os.str ();
+  }
+
+  class json_writer
+    : public value_writer
+  {
+    std::ostream &m_os;
+
+    // For each open object or list, whether an item was written to
+    // it yet, and thus whether the next one needs a comma.
+    std::vector <bool> m_seen;
+    bool m_after_field;
+
+    void
+    item ()
+    {
+      if (m_after_field)
+	m_after_field = false;
+      else if (! m_seen.empty ())
+	{
+	  if (m_seen.back ())
+	    m_os << ',';
+	  m_seen.back () = true;
+	}
+    }
+
+    void
+    quote (char const *s, size_t len)
+    {
+      m_os << '"';
+      for (size_t i = 0; i < len; ++i)
+	{
+	  unsigned char c = s[i];
+	  if (c == '"' || c == '\\')
+	    m_os << '\\' << c;
+	  else if (c == '\n')
+	    m_os << "\\n";
+	  else if (c == '\t')
+	    m_os << "\\t";
+	  else if (c < 0x20)
+	    {
+	      char buf[8];
+	      snprintf (buf, sizeof buf, "\\u%04x", c);
+	      m_os << buf;
+	    }
+	  else
+	    m_os << c;
+	}
+      m_os << '"';
+    }
+
+    void
+    quote (std::string const &s)
+    {
+      quote (s.c_str (), s.size ());
+    }
+
+  public:
+    explicit json_writer (std::ostream &os)
+      : m_os (os)
+      , m_after_field {false}
+    {}
+
+    void
+    begin (value_type type) override
+    {
+      item ();
+      m_os << "{\"type\":";
+      quote (type.name (), strlen (type.name ()));
+      m_seen.push_back (true);
+    }
+
+    void
+    field (char const *name) override
+    {
+      m_os << ',';
+      quote (name, strlen (name));
+      m_os << ':';
+      m_after_field = true;
+    }
+
+    void
+    end () override
+    {
+      m_os << '}';
+      m_seen.pop_back ();
+    }
+
+    void
+    begin_list () override
+    {
+      item ();
+      m_os << '[';
+      m_seen.push_back (false);
+    }
+
+    void
+    end_list () override
+    {
+      m_os << ']';
+      m_seen.pop_back ();
+    }
+
+    void
+    uint (uint64_t v) override
+    {
+      item ();
+      m_os << std::to_string (v);
+    }
+
+    void
+    str (std::string const &s) override
+    {
+      item ();
+      quote (s);
+    }
+
+    void
+    cst (constant const &c) override
+    {
+      item ();
+      mpz_class const &v = c.value ();
+      m_os << "{\"value\":"
+	   << (v.m_sign == signedness::sign
+	       ? std::to_string (v.m_i) : std::to_string (v.m_u))
+	   << ",\"domain\":";
+      quote (c.dom () != nullptr ? c.dom ()->name () : "");
+      m_os << ",\"text\":";
+      quote (constant_text (c));
+      m_os << '}';
+    }
+
+    void
+    result (std::string const &fn, stack &stk)
+    {
+      m_os << "{\"file\":";
+      quote (fn);
+      m_os << ",\"values\":";
+      begin_list ();
+      while (stk.size () > 0)
+	stk.pop ()->describe (*this);
+      end_list ();
+      m_os << "}\n";
+    }
+  };
+
+  class binary_writer
+    : public value_writer
+  {
+    std::string m_buf;
+
+    void
+    put (void const *data, size_t len)
+    {
+      m_buf.append (static_cast <char const *> (data), len);
+    }
+
+    void
+    put_u8 (uint8_t v)
+    {
+      put (&v, sizeof v);
+    }
+
+    void
+    put_u32 (uint32_t v)
+    {
+      put (&v, sizeof v);
+    }
+
+    void
+    put_u64 (uint64_t v)
+    {
+      put (&v, sizeof v);
+    }
+
+    void
+    put_str (char const *s, size_t len)
+    {
+      put_u32 (len);
+      put (s, len);
+    }
+
+    void
+    put_str (std::string const &s)
+    {
+      put_str (s.c_str (), s.size ());
+    }
+
+  public:
+    void
+    begin (value_type type) override
+    {
+      put_u8 ('{');
+      put_str (type.name (), strlen (type.name ()));
+    }
+
+    void
+    field (char const *name) override
+    {
+      put_u8 ('f');
+      put_str (name, strlen (name));
+    }
+
+    void
+    end () override
+    {
+      put_u8 ('}');
+    }
+
+    void
+    begin_list () override
+    {
+      put_u8 ('[');
+    }
+
+    void
+    end_list () override
+    {
+      put_u8 (']');
+    }
+
+    void
+    uint (uint64_t v) override
+    {
+      put_u8 ('u');
+      put_u64 (v);
+    }
+
+    void
+    str (std::string const &s) override
+    {
+      put_u8 ('s');
+      put_str (s);
+    }
+
+    void
+    cst (constant const &c) override
+    {
+      mpz_class const &v = c.value ();
+      put_u8 ('c');
+      put_u8 (v.m_sign == signedness::sign ? 1 : 0);
+      put_u64 (v.m_u);
+      put_str (c.dom () != nullptr ? c.dom ()->name () : "");
+      put_str (constant_text (c));
+    }
+
+    void
+    result (std::ostream &os, std::string const &fn, stack &stk)
+    {
+      // Make room for the size, which is only known at the end.
+      m_buf.assign (sizeof (uint32_t), '\0');
+      put_str (fn);
+      put_u32 (stk.size ());
+      while (stk.size () > 0)
+	stk.pop ()->describe (*this);
+
+      uint32_t size = m_buf.size () - sizeof (uint32_t);
+      memcpy (&m_buf[0], &size, sizeof size);
+      os.write (m_buf.data (), m_buf.size ());
+    }
+  };
+}
+
+void
+begin_output (std::ostream &os, output_format fmt)
+{
+  if (fmt == output_format::binary)
+    {
+      uint32_t const header[] = {0x01020304, 0};
+      os.write ("DWGREPB1", 8);
+      os.write (reinterpret_cast <char const *> (header), sizeof header);
+    }
+}
+
+void
+write_result (std::ostream &os, output_format fmt,
+	      std::string const &fn, stack &stk)
+{
+  switch (fmt)
+    {
+    case output_format::jsonl:
+      json_writer {os}.result (fn, stk);
+      return;
+
+    case output_format::binary:
+      binary_writer {}.result (os, fn, stk);
+      return;
+
+    case output_format::text:
+      break;
+    }
+
+  assert (! "Should never get here.");
+  abort ();
+}
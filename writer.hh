@@ -0,0 +1,89 @@
+/*
+   Copyright (C) 2014 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _WRITER_H_
+#define _WRITER_H_
+
+#include <iosfwd>
+#include <string>
+
+#include "stack.hh"
+
+// How query results are written out.
+//
+// In text format, each value is shown on a line of its own, the way
+// value::show presents it.
+//
+// In jsonl format, each result is a JSON object on a line of its
+// own: {"file": FILE, "values": [VALUE...]}.  Values are listed from
+// the top of the stack down, the same order in which text format
+// shows them.  Each value is an object with a "type" member holding
+// the value type name (such as "T_DIE"), and members for the fields
+// of the value (see value::describe).  Constants are objects with
+// members "value", "domain" and "text".
+//
+// In binary format, the output starts with a 16-byte header: the
+// eight characters "DWGREPB1", then a 32-bit number 0x01020304, which
+// tells the byte order that all numbers that follow are stored in,
+// then a 32-bit zero.  Each result is then a record:
+//
+//   u32 size of the rest of the record in bytes
+//   STR file name
+//   u32 number of values
+//   ITEM... values, from the top of the stack down
+//
+// where STR is a u32 length followed by that many bytes, and ITEM is
+// a single byte that tells what follows:
+//
+//   '{' STR type, then fields, each a byte 'f', STR name and ITEM,
+//       and then a byte '}'
+//   '[' ITEM... ']'
+//   'u' u64 unsigned number
+//   's' STR string
+//   'c' u8 1 if the value is signed, 0 otherwise, u64 value, STR
+//       domain, STR text
+//
+// Numbers are not aligned.  A reader can walk the records by their
+// sizes without decoding them.
+enum class output_format
+  {
+    text,
+    jsonl,
+    binary,
+  };
+
+// Write whatever FMT needs at the beginning of output to OS.
+void begin_output (std::ostream &os, output_format fmt);
+
+// Write result STK, which was found in file FN, to OS in format FMT,
+// which is one of the structured formats.  Values are popped off STK
+// as they are written.
+void write_result (std::ostream &os, output_format fmt,
+		   std::string const &fn, stack &stk);
+
+#endif /* _WRITER_H_ */